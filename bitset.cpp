@@ -10,107 +10,10 @@
 #include <algorithm>
 #include <cassert>
 #include <sstream>
+#include <chrono>
 
-/*
- * Author:  David Robert Nadeau
- * Site:    http://NadeauSoftware.com/
- * License: Creative Commons Attribution 3.0 Unported License
- *          http://creativecommons.org/licenses/by/3.0/deed.en_US
- */
-
-// #if defined(_WIN32)
-// #include <Windows.h>
-
-// #elif defined(__unix__) || defined(__unix) || defined(unix) || (defined(__APPLE__) && defined(__MACH__))
-// #include <unistd.h>
-// #include <sys/resource.h>
-// #include <sys/times.h>
-// #include <time.h>
-
-// #else
-// #error "Unable to define getCPUTime( ) for an unknown OS."
-// #endif
-
-// /**
-//  * Returns the amount of CPU time used by the current process,
-//  * in seconds, or -1.0 if an error occurred.
-//  */
-// double getCPUTime( )
-// {
-// #if defined(_WIN32)
-//     /* Windows -------------------------------------------------- */
-//     FILETIME createTime;
-//     FILETIME exitTime;
-//     FILETIME kernelTime;
-//     FILETIME userTime;
-//     if ( GetProcessTimes( GetCurrentProcess( ),
-//         &createTime, &exitTime, &kernelTime, &userTime ) != -1 )
-//     {
-//         SYSTEMTIME userSystemTime;
-//         if ( FileTimeToSystemTime( &userTime, &userSystemTime ) != -1 )
-//             return (double)userSystemTime.wHour * 3600.0 +
-//                 (double)userSystemTime.wMinute * 60.0 +
-//                 (double)userSystemTime.wSecond +
-//                 (double)userSystemTime.wMilliseconds / 1000.0;
-//     }
-
-// #elif defined(__unix__) || defined(__unix) || defined(unix) || (defined(__APPLE__) && defined(__MACH__))
-//     /* AIX, BSD, Cygwin, HP-UX, Linux, OSX, and Solaris --------- */
-
-// #if defined(_POSIX_TIMERS) && (_POSIX_TIMERS > 0)
-//     /* Prefer high-res POSIX timers, when available. */
-//     {
-//         clockid_t id;
-//         struct timespec ts;
-// #if _POSIX_CPUTIME > 0
-//         /* Clock ids vary by OS.  Query the id, if possible. */
-//         if ( clock_getcpuclockid( 0, &id ) == -1 )
-// #endif
-// #if defined(CLOCK_PROCESS_CPUTIME_ID)
-//             /* Use known clock id for AIX, Linux, or Solaris. */
-//             id = CLOCK_PROCESS_CPUTIME_ID;
-// #elif defined(CLOCK_VIRTUAL)
-//             /* Use known clock id for BSD or HP-UX. */
-//             id = CLOCK_VIRTUAL;
-// #else
-//             id = (clockid_t)-1;
-// #endif
-//         if ( id != (clockid_t)-1 && clock_gettime( id, &ts ) != -1 )
-//             return (double)ts.tv_sec +
-//                 (double)ts.tv_nsec / 1000000000.0;
-//     }
-// #endif
-
-// #if defined(RUSAGE_SELF)
-//     {
-//         struct rusage rusage;
-//         if ( getrusage( RUSAGE_SELF, &rusage ) != -1 )
-//             return (double)rusage.ru_utime.tv_sec +
-//                 (double)rusage.ru_utime.tv_usec / 1000000.0;
-//     }
-// #endif
-
-// #if defined(_SC_CLK_TCK)
-//     {
-//         const double ticks = (double)sysconf( _SC_CLK_TCK );
-//         struct tms tms;
-//         if ( times( &tms ) != (clock_t)-1 )
-//             return (double)tms.tms_utime / ticks;
-//     }
-// #endif
-
-// #if defined(CLOCKS_PER_SEC)
-//     {
-//         clock_t cl = clock( );
-//         if ( cl != (clock_t)-1 )
-//             return (double)cl / (double)CLOCKS_PER_SEC;
-//     }
-// #endif
-
-// #endif
-
-//     return -1;      /* Failed. */
-// }
+#include "c++11/bitset.h"
+#include "rtcp_stats.h"
 
 class NTPTimeStamp {
 public:
@@ -152,6 +55,7 @@ public:
 };
 
 using namespace std;
+using Toolkit::Cbitset;
 
 ostream& operator<< (ostream& o, const NTPTimeStamp& ts) {
     return o << "Timestamp: " << endl
@@ -227,83 +131,131 @@ void test_2() {
     ;
 }
 
-class Cbitset {
-protected:
-    size_t m_nSize;
-    std::vector<uint8_t> m_Data;
-public:
-    virtual ~Cbitset() = default;
-    Cbitset(Cbitset &&) = default;
-    Cbitset(const Cbitset &) = default;
-    explicit Cbitset(size_t nBits, uint64_t value)
-    : m_nSize(0)
-    {
-        size_t nBytes = resize(nBits);;
-        std::fill_n(m_Data.begin(), m_Data.size(), 0);
-        if (m_nSize < sizeof(uint64_t)) {
-            assert(nBytes < 3);
-            uint64_t maskedValue = value & ((1 << (m_nSize + 1)) - 1);
-            for (size_t i = 0; i < m_Data.size(); i++) {
-                m_Data[i] = (maskedValue >> (i * 8)) & 0xff;
-            }
-        } else {
-            for (size_t i = 0; i < sizeof(uint64_t); i++) {
-                m_Data[i] = (value >> (i * 8)) & 0xff;
-            }
+/*
+ * The same arithmetic with packed 32.32 timestamps: no carries between two
+ * fields and no conversion to double until printing.
+ */
+void test_3() {
+    ntp64_t t1 = ntp_make(0xb710, 0x80000000); // 46864.500 (s)
+    ntp64_t t2 = ntp_make(0x0005, 0x40000000); // 5.250 (s)
+    ntp64_t t3 = ntp_make(0xb705, 0x20000000); // 46853.125 (s)
+    ntp64_t t4 = t1 - t2 - t3;
+    cout << "TEST_3: Expected value: 6.125 (s)" << endl
+         << "packed: " << bitset<64>(t4) << endl
+         << "us: " << ntp_to_us(t4) << endl;
+
+    // Round-trip time from the middle 32 bits, as in a receiver block:
+    // SR sent at t3, held by the receiver for 5.250 s, answer received at t1
+    uint32_t lsr = ntp_middle32(t3), dlsr = ntp_middle32(t2), arrival = ntp_middle32(t1);
+    cout << "rtt: " << ntp32_to_us(arrival - lsr - dlsr) << " (us)" << endl;
+}
+
+/*
+ * One report per stream per round, every stream with its own SSRC.
+ */
+void bench_stats(size_t nStreams, size_t rounds) {
+    RTCPStatsEngine engine;
+    RTCPReportBatch batch;
+    batch.reserve(nStreams);
+    uint8_t block[RTCPReportBlockView::SIZE];
+    auto put32 = [](uint8_t* p, uint32_t v) {
+        p[0] = v >> 24; p[1] = (v >> 16) & 0xff; p[2] = (v >> 8) & 0xff; p[3] = v & 0xff;
+    };
+
+    double secs = 0;
+    for (size_t r = 0; r < rounds; r++) {
+        batch.clear();
+        ntp64_t now = ntp_from_us(1000000ULL * (r + 100));
+        for (size_t i = 0; i < nStreams; i++) {
+            put32(block, (uint32_t)i);
+            put32(block + 4, (uint32_t)(r * (i % 5)));
+            put32(block + 8, (uint32_t)(r * 50));
+            put32(block + 12, (uint32_t)(i % 900));
+            put32(block + 16, ntp_middle32(now - ntp_from_us(90000 + i % 1000)));
+            put32(block + 20, 0x00000CCC); // 50 ms
+            batch.push(RTCPReportBlockView(block), now);
         }
+        auto t0 = chrono::steady_clock::now();
+        engine.update(batch);
+        secs += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
     }
 
-    size_t         bits_num() const { return m_nSize; }
-    size_t         size()           { return m_Data.size(); }
-    const uint8_t* data()     const { return m_Data.data(); }
-    uint8_t*       data()           { return m_Data.data(); }
+    RTCPStreamStats st;
+    if (engine.find(7, st)) {
+        cout << "ssrc=7 rtt=" << st.rttUs << " us, jitter=" << st.jitterUs
+             << " us, lost=" << st.cumulativeLost << " (" << st.intervalLost
+             << "/" << st.intervalExpected << " in the last interval)" << endl;
+    }
+    cout << "stats: " << engine.streams() << " streams, " << nStreams * rounds
+         << " reports in " << secs << " s (" << secs * 1e9 / (nStreams * rounds)
+         << " ns/report)" << endl;
+}
 
-    size_t resize(size_t nBits) {
-        m_nSize = nBits;
-        size_t nBytes;
-        if (m_nSize < 8) {
-            nBytes = 1;
-        } else {
-            nBytes = 1 + (m_nSize - 1) / 8;
+/*
+ * Old to_string() implementation, kept to compare against the table-driven
+ * Cbitset::to_chars().
+ */
+std::string to_string_ss(const Cbitset& bits, unsigned int blk = 4) {
+    std::stringstream ss;
+    size_t nBits = bits.bits_num();
+    bool formatting = (blk > 0 && blk < nBits) ? true : false;
+    for (size_t i = 0; i < nBits; i++) {
+        ss << (bits[nBits - i - 1] ? "1" : "0");
+        if (formatting && !((i+1) % blk)) {
+            ss << " ";
         }
-        m_Data.resize(nBytes);
-        return nBytes;
     }
+    return ss.str();
+}
 
-    bool operator[](size_t pos) const {
-        size_t byte = pos / 8, offset = pos % 8;
-        return (m_Data[byte] >> offset) & 0x1;
+void bench_to_string(size_t nBits, unsigned int blk, size_t iterations) {
+    Cbitset bits(nBits, 0xb7108000b7108000ULL);
+    for (size_t i = 64; i < nBits; i += 3) {
+        bits.set(i);
     }
 
-    std::string to_string(unsigned int blk = 4) const {
-        std::stringstream ss;
-        bool formatting = (blk > 0 && blk < m_nSize) ? true : false;
-        for (size_t i = 0; i < m_nSize; i++) {
-            ss << ((*this)[m_nSize - i - 1] ? "1" : "0");
-            if (formatting && !((i+1) % blk)) {
-                ss << " ";
-            }
-        }
-        return ss.str();
+    if (to_string_ss(bits, blk) != bits.to_string(blk)) {
+        cout << "bench_to_string: outputs differ for " << nBits << " bits" << endl;
+        return;
     }
-};
+
+    std::vector<char> buffer(bits.chars_num(blk));
+    size_t sink = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        sink += to_string_ss(bits, blk).size();
+    }
+    auto t1 = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        sink += bits.to_string(blk).size();
+    }
+    auto t2 = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        sink += bits.to_chars(buffer.data(), buffer.data() + buffer.size(), blk) - buffer.data();
+    }
+    auto t3 = chrono::steady_clock::now();
+
+    auto ns = [iterations](chrono::steady_clock::duration d) {
+        return (double)chrono::duration_cast<chrono::nanoseconds>(d).count() / iterations;
+    };
+    cout << "bits=" << nBits << " blk=" << blk << " (" << sink << ")" << endl
+         << "  stringstream: " << ns(t1 - t0) << " ns/call" << endl
+         << "  to_string:    " << ns(t2 - t1) << " ns/call" << endl
+         << "  to_chars:     " << ns(t3 - t2) << " ns/call" << endl;
+}
 
 int main(int argc, char* argv[]) {
 
     cout << Cbitset(sizeof(int) * 8, 0xb710).to_string() << endl;
+    bench_to_string(32, 4, 1000000);
+    bench_to_string(32, 0, 1000000);
+    bench_to_string(1024, 8, 100000);
     //test_1();
+    test_3();
+    bench_stats(50000, 20);
     //test_2();
     //bitset<sizeof(int) * 8> tt(5);
     //printf("Test: %s\n", tt.to_string().c_str());
 
     return 0;
 }
-
-/*
-
-ts32.secs = ts.secs & 0x0000FFFF;
-ts32.frac = ts.frac & 0xFFFF0000;
-lsr32.secs = (rb.lastTimeStamp & 0xFFFF0000) >> 16;
-lsr32.frac = (rb.lastTimeStamp & 0x0000FFFF) << 16;
-
-*/
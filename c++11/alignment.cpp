@@ -31,6 +31,11 @@
 #include <cstdio>
 #include <iostream>
 #include <cstring>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "bitdump.h"
 
 struct data_test_1 {
     unsigned int    m_integer;
@@ -285,25 +290,97 @@ void test_reverse_nums()
     std::cout << "Test 1: " << reverse_int(iNumber) << std::endl;
 }
 
-void print_dump(const char* startAddr, size_t size)
+/*
+ * Дамп памяти. Каждая строка содержит адрес и 16 байт в шестнадцатеричном
+ * виде, либо 4 байта в двоичном. Строки собираются в буфер и выводятся
+ * крупными блоками, а сами байты раскладываются в символы векторными ядрами
+ * из bitdump.h (SSE2/AVX2 выбирается во время выполнения), поэтому функция
+ * подходит и для дампа больших файлов.
+ */
+void print_dump(const char* startAddr, size_t size, bool binary = false)
 {
-    short columnSize = 3, i = 0;
-    printf("printing dump (sizeof=%ld):\n", size);
-    printf("%08X:   ", startAddr);
-    for (char* addr = (char*)startAddr; addr < (startAddr + size); addr++)
+    const size_t columns = binary ? 4 : 16;
+    const size_t flushSize = 64 * 1024;
+    std::vector<char> out;
+    out.reserve(flushSize + 256);
+    printf("printing dump (sizeof=%zu):\n", size);
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(startAddr);
+    for (size_t offset = 0; offset < size; offset += columns)
     {
-        if (i > columnSize) {
-            printf("\n%08X:   ", addr);
-            i = 0;
+        size_t n = std::min(columns, size - offset);
+        uint64_t addr = reinterpret_cast<uintptr_t>(bytes + offset);
+        uint8_t addrBytes[sizeof(addr)];
+        for (size_t i = 0; i < sizeof(addr); i++) {
+            addrBytes[i] = (addr >> ((sizeof(addr) - i - 1) * 8)) & 0xff;
+        }
+        char row[256];
+        char* p = Toolkit::hex_to_chars(addrBytes, sizeof(addrBytes), row, 0, true);
+        std::memcpy(p, ":   ", 4);
+        p += 4;
+        if (binary) {
+            p = Toolkit::bits_to_chars(bytes + offset, n, p, 8);
+        } else {
+            p = Toolkit::hex_to_chars(bytes + offset, n, p, 2, true);
+        }
+        *p++ = '\n';
+        out.insert(out.end(), row, p);
+        if (out.size() >= flushSize) {
+            fwrite(out.data(), 1, out.size(), stdout);
+            out.clear();
+        }
+    }
+    fwrite(out.data(), 1, out.size(), stdout);
+}
+
+/*
+ * Самопроверка ядер bitdump.h: вывод каждого уровня, доступного процессору,
+ * сравнивается с табличным вариантом на случайных данных. Длины вокруг 4, 8,
+ * 16 и 32 байт проверяют переход векторного цикла на скалярный хвост.
+ */
+bool check_bitdump()
+{
+    using Toolkit::SimdLevel;
+    const size_t edges[] = { 0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128, 129 };
+    const unsigned blks[] = { 0, 1, 2, 3, 8, 13 };
+    std::vector<uint8_t> src(512 + 1);
+    std::vector<char> expected(Toolkit::bits_chars_num(512, 1));
+    std::vector<char> actual(expected.size());
+    unsigned seed = 1;
+    auto next = [&seed]() { seed = seed * 1103515245 + 12345; return seed >> 16; };
+
+    for (int level = (int)SimdLevel::eSSE2; level <= (int)Toolkit::simd_level(); level++)
+    {
+        for (size_t round = 0; round < 2000; round++)
+        {
+            size_t n = round < sizeof(edges) / sizeof(edges[0]) ? edges[round] : next() % 512;
+            const uint8_t* data = src.data() + next() % 2; // и невыровненные адреса
+            for (size_t i = 0; i < src.size(); i++) src[i] = (uint8_t)next();
+            unsigned blk = blks[next() % (sizeof(blks) / sizeof(blks[0]))];
+            bool upper = next() % 2;
+
+            char* e = Toolkit::bits_to_chars(data, n, expected.data(), blk, SimdLevel::eSCALAR);
+            char* a = Toolkit::bits_to_chars(data, n, actual.data(), blk, (SimdLevel)level);
+            bool same = e - expected.data() == a - actual.data()
+                && std::equal(expected.data(), e, actual.data());
+            e = Toolkit::hex_to_chars(data, n, expected.data(), blk, upper, SimdLevel::eSCALAR);
+            a = Toolkit::hex_to_chars(data, n, actual.data(), blk, upper, (SimdLevel)level);
+            same = same && e - expected.data() == a - actual.data()
+                && std::equal(expected.data(), e, actual.data());
+            if (!same)
+            {
+                printf("bitdump: level %d differs from scalar, %zu bytes, blk %u\n", level, n, blk);
+                return false;
+            }
         }
-        printf("%08X ", *addr);
-        i++;
     }
-    printf("\n");
+    printf("bitdump: SIMD kernels up to level %d match scalar\n", (int)Toolkit::simd_level());
+    return true;
 }
 
 int main(int argc, char* argv[])
 {
+    if (!check_bitdump())
+        return 1;
     //1
     test_big_little_endian();
     if (is_big_endian())
@@ -325,5 +402,6 @@ int main(int argc, char* argv[])
     //3
     print_dump((const char*)&test_1, sizeof test_1);
     print_dump((const char*)&test_4, sizeof test_4);
+    print_dump((const char*)&test_4, sizeof test_4, true);
     return 0;
 }
\ No newline at end of file
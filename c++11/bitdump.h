@@ -0,0 +1,295 @@
+#ifndef BITDUMP_H
+#define BITDUMP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "bitset.h"
+#include "simd.h"
+
+#ifdef TOOLKIT_X86
+#define BITDUMP_X86 1
+#endif
+
+namespace Toolkit {
+
+namespace detail {
+
+/**
+ * @brief Precomputed hex digits of every byte value, upper and lower case.
+ */
+struct hex_table {
+    char digits[2][256][2];
+    hex_table() {
+        const char* alphabet[2] = { "0123456789abcdef", "0123456789ABCDEF" };
+        for (unsigned c = 0; c < 2; c++) {
+            for (unsigned b = 0; b < 256; b++) {
+                digits[c][b][0] = alphabet[c][b >> 4];
+                digits[c][b][1] = alphabet[c][b & 0xf];
+            }
+        }
+    }
+};
+
+inline const hex_table& hex_chars() {
+    static const hex_table table;
+    return table;
+}
+
+/*
+ * Raw kernels: expand n source bytes into out without delimiters.
+ * Binary kernels write 8 characters per byte (most significant bit first),
+ * hex kernels write 2.
+ */
+typedef void (*bits_kernel)(const uint8_t* src, size_t n, char* out);
+typedef void (*hex_kernel)(const uint8_t* src, size_t n, char* out, bool upper);
+
+inline void bits_scalar(const uint8_t* src, size_t n, char* out) {
+    const bin_table& table = bin_chars();
+    for (size_t i = 0; i < n; i++, out += 8) {
+        std::memcpy(out, table.digits[src[i]], 8);
+    }
+}
+
+inline void hex_scalar(const uint8_t* src, size_t n, char* out, bool upper) {
+    const hex_table& table = hex_chars();
+    for (size_t i = 0; i < n; i++, out += 2) {
+        std::memcpy(out, table.digits[upper][src[i]], 2);
+    }
+}
+
+#ifdef BITDUMP_X86
+
+/*
+ * Every source byte is replicated into 8 lanes, each lane keeps one bit
+ * (0x80 ... 0x01) and the comparison turns it into 0x00/0xFF. Subtracting
+ * that from '0' gives '0'/'1'.
+ */
+__attribute__((target("sse2")))
+inline __m128i bits_sse2_lanes(__m128i spread) {
+    const __m128i mask = _mm_setr_epi8(
+        (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+        (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    __m128i set = _mm_cmpeq_epi8(_mm_and_si128(spread, mask), mask);
+    return _mm_sub_epi8(_mm_set1_epi8('0'), set);
+}
+
+__attribute__((target("sse2")))
+inline void bits_sse2(const uint8_t* src, size_t n, char* out) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8, out += 64) {
+        __m128i v  = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+        __m128i x  = _mm_unpacklo_epi8(v, v);   // b0 b0 b1 b1 ... b7 b7
+        __m128i lo = _mm_unpacklo_epi16(x, x);  // b0 x4 ... b3 x4
+        __m128i hi = _mm_unpackhi_epi16(x, x);  // b4 x4 ... b7 x4
+        __m128i* dst = reinterpret_cast<__m128i*>(out);
+        _mm_storeu_si128(dst + 0, bits_sse2_lanes(_mm_unpacklo_epi32(lo, lo)));
+        _mm_storeu_si128(dst + 1, bits_sse2_lanes(_mm_unpackhi_epi32(lo, lo)));
+        _mm_storeu_si128(dst + 2, bits_sse2_lanes(_mm_unpacklo_epi32(hi, hi)));
+        _mm_storeu_si128(dst + 3, bits_sse2_lanes(_mm_unpackhi_epi32(hi, hi)));
+    }
+    bits_scalar(src + i, n - i, out);
+}
+
+/*
+ * Nibbles are interleaved (high first) and mapped to ASCII as
+ * '0' + n, plus the distance to 'a'/'A' for n > 9.
+ */
+__attribute__((target("sse2")))
+inline __m128i hex_sse2_ascii(__m128i nibbles, __m128i alpha) {
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), alpha);
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+
+__attribute__((target("sse2")))
+inline void hex_sse2(const uint8_t* src, size_t n, char* out, bool upper) {
+    const __m128i low4 = _mm_set1_epi8(0x0f);
+    const __m128i alpha = _mm_set1_epi8(upper ? 'A' - '0' - 10 : 'a' - '0' - 10);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16, out += 32) {
+        __m128i v  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low4);
+        __m128i lo = _mm_and_si128(v, low4);
+        __m128i* dst = reinterpret_cast<__m128i*>(out);
+        _mm_storeu_si128(dst + 0, hex_sse2_ascii(_mm_unpacklo_epi8(hi, lo), alpha));
+        _mm_storeu_si128(dst + 1, hex_sse2_ascii(_mm_unpackhi_epi8(hi, lo), alpha));
+    }
+    hex_scalar(src + i, n - i, out, upper);
+}
+
+__attribute__((target("avx2")))
+inline void bits_avx2(const uint8_t* src, size_t n, char* out) {
+    const __m256i spread = _mm256_setr_epi8(
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+        2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i mask = _mm256_setr_epi8(
+        (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+        (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+        (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+        (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    const __m256i zero = _mm256_set1_epi8('0');
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4, out += 32) {
+        int32_t word;
+        std::memcpy(&word, src + i, sizeof(word));
+        __m256i x = _mm256_shuffle_epi8(_mm256_set1_epi32(word), spread);
+        __m256i set = _mm256_cmpeq_epi8(_mm256_and_si256(x, mask), mask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_sub_epi8(zero, set));
+    }
+    bits_scalar(src + i, n - i, out);
+}
+
+__attribute__((target("avx2")))
+inline __m256i hex_avx2_ascii(__m256i nibbles, __m256i alpha) {
+    __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(nibbles, _mm256_set1_epi8(9)), alpha);
+    return _mm256_add_epi8(_mm256_add_epi8(nibbles, _mm256_set1_epi8('0')), letters);
+}
+
+__attribute__((target("avx2")))
+inline void hex_avx2(const uint8_t* src, size_t n, char* out, bool upper) {
+    const __m256i low4 = _mm256_set1_epi8(0x0f);
+    const __m256i alpha = _mm256_set1_epi8(upper ? 'A' - '0' - 10 : 'a' - '0' - 10);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32, out += 64) {
+        __m256i v  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low4);
+        __m256i lo = _mm256_and_si256(v, low4);
+        // unpack works inside 128-bit lanes: a = bytes 0-7 | 16-23, b = 8-15 | 24-31
+        __m256i a = hex_avx2_ascii(_mm256_unpacklo_epi8(hi, lo), alpha);
+        __m256i b = hex_avx2_ascii(_mm256_unpackhi_epi8(hi, lo), alpha);
+        __m256i* dst = reinterpret_cast<__m256i*>(out);
+        _mm256_storeu_si256(dst + 0, _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256(dst + 1, _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    hex_sse2(src + i, n - i, out, upper);
+}
+
+#endif // BITDUMP_X86
+
+inline bits_kernel select_bits_kernel(SimdLevel level) {
+    level = std::min(level, simd_level());
+#ifdef BITDUMP_X86
+    if (level == SimdLevel::eAVX2) return bits_avx2;
+    if (level == SimdLevel::eSSE2) return bits_sse2;
+#endif
+    return bits_scalar;
+}
+
+inline hex_kernel select_hex_kernel(SimdLevel level) {
+    level = std::min(level, simd_level());
+#ifdef BITDUMP_X86
+    if (level == SimdLevel::eAVX2) return hex_avx2;
+    if (level == SimdLevel::eSSE2) return hex_sse2;
+#endif
+    return hex_scalar;
+}
+
+/**
+ * @brief Inserts a space after every blk characters of [src, src + n).
+ *
+ * @param left Characters remaining until the next delimiter, carried
+ * between calls
+ */
+inline char* copy_delimited(const char* src, size_t n, char* out, unsigned blk, size_t& left) {
+    while (n) {
+        size_t k = std::min(n, left);
+        std::memcpy(out, src, k);
+        out += k;
+        src += k;
+        n -= k;
+        left -= k;
+        if (!left) {
+            *out++ = ' ';
+            left = blk;
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief Runs a raw kernel over the source, inserting delimiters the same
+ * way Cbitset::to_string(blk) does: a space after every blk characters,
+ * unless blk is zero or not less than the whole output.
+ */
+template <class Kernel>
+char* expand(Kernel kernel, size_t width, const uint8_t* src, size_t n, char* out, unsigned blk) {
+    size_t total = n * width;
+    if (blk == 0 || blk >= total) {
+        kernel(src, n, out);
+        return out + total;
+    }
+    const size_t CHUNK = 64;
+    char tmp[CHUNK * 8];
+    size_t left = blk;
+    for (size_t i = 0; i < n; i += CHUNK) {
+        size_t m = std::min(CHUNK, n - i);
+        kernel(src + i, m, tmp);
+        out = copy_delimited(tmp, m * width, out, blk, left);
+    }
+    return out;
+}
+
+inline size_t delimited_size(size_t total, unsigned blk) {
+    return total + ((blk > 0 && blk < total) ? total / blk : 0);
+}
+
+} // namespace detail
+
+/**
+ * @brief Returns the number of characters written by bits_to_chars().
+ */
+inline size_t bits_chars_num(size_t n, unsigned blk = 0) {
+    return detail::delimited_size(n * 8, blk);
+}
+
+/**
+ * @brief Returns the number of characters written by hex_to_chars().
+ */
+inline size_t hex_chars_num(size_t n, unsigned blk = 0) {
+    return detail::delimited_size(n * 2, blk);
+}
+
+/**
+ * @brief Writes the bytes [src, src + n) as binary digits, most significant
+ * bit of each byte first.
+ *
+ * The output buffer must hold bits_chars_num(n, blk) characters. The output
+ * is not null-terminated.
+ *
+ * @param blk Sets the size of the block of digits between which a space
+ * will be affixed, as in Cbitset::to_string().
+ * @param level Highest instruction set to use, capped by simd_level().
+ * @return Pointer past the last written character
+ */
+inline char* bits_to_chars(const uint8_t* src, size_t n, char* out, unsigned blk = 0,
+                           SimdLevel level = SimdLevel::eAVX2) {
+    static const detail::bits_kernel best = detail::select_bits_kernel(SimdLevel::eAVX2);
+    detail::bits_kernel kernel = (level == SimdLevel::eAVX2) ? best : detail::select_bits_kernel(level);
+    return detail::expand(kernel, 8, src, n, out, blk);
+}
+
+/**
+ * @brief Writes the bytes [src, src + n) as hex digits, two per byte.
+ *
+ * The output buffer must hold hex_chars_num(n, blk) characters. The output
+ * is not null-terminated.
+ *
+ * @param blk Sets the size of the block of digits between which a space
+ * will be affixed (2 separates bytes).
+ * @param upper Use upper case letters.
+ * @param level Highest instruction set to use, capped by simd_level().
+ * @return Pointer past the last written character
+ */
+inline char* hex_to_chars(const uint8_t* src, size_t n, char* out, unsigned blk = 0,
+                          bool upper = false, SimdLevel level = SimdLevel::eAVX2) {
+    static const detail::hex_kernel best = detail::select_hex_kernel(SimdLevel::eAVX2);
+    detail::hex_kernel kernel = (level == SimdLevel::eAVX2) ? best : detail::select_hex_kernel(level);
+    return detail::expand([kernel, upper](const uint8_t* s, size_t m, char* o) { kernel(s, m, o, upper); },
+                          2, src, n, out, blk);
+}
+
+}
+
+#endif
@@ -5,99 +5,444 @@
 #include <vector>
 #include <algorithm>
 #include <cassert>
-#include <sstream>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace Toolkit {
 
+namespace detail {
+
+/**
+ * @brief Number of set bits in a 64-bit word.
+ *
+ * GCC/Clang emit POPCNT when the target allows it (-mpopcnt, -march=native),
+ * otherwise a short bit-twiddling sequence.
+ */
+inline unsigned popcount64(uint64_t w) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_popcountll(w));
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return static_cast<unsigned>(__popcnt64(w));
+#else
+    w = w - ((w >> 1) & 0x5555555555555555ULL);
+    w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+    w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return static_cast<unsigned>((w * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/**
+ * @brief Index of the least significant set bit. The word must not be zero.
+ */
+inline unsigned ctz64(uint64_t w) {
+    assert(w != 0);
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_ctzll(w));
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long idx;
+    _BitScanForward64(&idx, w);
+    return static_cast<unsigned>(idx);
+#else
+    unsigned n = 0;
+    while (!(w & 0x1)) { w >>= 1; n++; }
+    return n;
+#endif
+}
+
+/**
+ * @brief Converts a word between the host order and the little-endian order
+ * of the storage. The conversion is symmetric, so it is used for both loads
+ * and stores.
+ */
+inline uint64_t le64(uint64_t w) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    return __builtin_bswap64(w);
+#else
+    return w;
+#endif
+}
+
+/**
+ * @brief Precomputed binary digits of every byte value, most significant
+ * bit first.
+ */
+struct bin_table {
+    char digits[256][8];
+    bin_table() {
+        for (unsigned b = 0; b < 256; b++) {
+            for (unsigned k = 0; k < 8; k++) {
+                digits[b][k] = ((b >> (7 - k)) & 0x1) ? '1' : '0';
+            }
+        }
+    }
+};
+
+inline const bin_table& bin_chars() {
+    static const bin_table table;
+    return table;
+}
+
+} // namespace detail
+
 /**
  * @brief Dynamic bitset. Allows you to represent an integer in binary form.
- * 
+ *
+ * Bits are kept in 64-bit words, so bulk operations (&=, |=, ^=, ~, shifts,
+ * count(), find_first()/find_next()) handle 64 bits per step. Words are stored
+ * little-endian: data() exposes the same byte layout as a plain byte array
+ * where byte N holds bits [8*N, 8*N+7].
  */
 class Cbitset {
 protected:
+    static const size_t WORD_BITS = 64;
+
     size_t m_nBits;
-    std::vector<uint8_t> m_Data;
+    std::vector<uint64_t> m_Words;
+
+    uint64_t load(size_t i) const           { return detail::le64(m_Words[i]); }
+    void     store(size_t i, uint64_t word) { m_Words[i] = detail::le64(word); }
+
+    /**
+     * @brief Clears the unused bits of the last word so that count() and
+     * find_*() never see bits above bits_num().
+     */
+    void trim() {
+        size_t tail = m_nBits % WORD_BITS;
+        if (m_nBits == 0) {
+            m_Words[0] = 0;
+        } else if (tail) {
+            size_t last = m_Words.size() - 1;
+            store(last, load(last) & ((1ULL << tail) - 1));
+        }
+    }
+
 public:
+    static const size_t npos = static_cast<size_t>(-1);
+
     virtual ~Cbitset() = default;
     Cbitset(Cbitset &&) = default;
     Cbitset(const Cbitset &) = default;
-    
+    Cbitset& operator=(Cbitset &&) = default;
+    Cbitset& operator=(const Cbitset &) = default;
+
     /**
      * @brief Construct a new Cbitset object
-     * 
+     *
      * @param nBits Number of bits for the value
-     * @param value 
+     * @param value Initial value, truncated to nBits
      */
-    explicit Cbitset(size_t nBits, uint64_t value)
+    explicit Cbitset(size_t nBits, uint64_t value = 0)
     : m_nBits(0)
     {
-        size_t nBytes = resize(nBits); // m_nBits updated
-        std::fill_n(m_Data.begin(), m_Data.size(), 0);
-        if (m_nBits < sizeof(uint64_t)) {
-            assert(nBytes < 3);
-            uint64_t maskedValue = value & ((1 << (m_nBits + 1)) - 1);
-            for (size_t i = 0; i < m_Data.size(); i++) {
-                m_Data[i] = (maskedValue >> (i * 8)) & 0xff;
-            }
-        } else {
-            for (size_t i = 0; i < sizeof(uint64_t); i++) {
-                m_Data[i] = (value >> (i * 8)) & 0xff;
-            }
-        }
+        resize(nBits); // m_nBits updated
+        std::fill(m_Words.begin(), m_Words.end(), 0);
+        store(0, value);
+        trim();
     }
 
-    size_t         bits_num() const { return m_nBits; }
-    size_t         size()           { return m_Data.size(); }
-    const uint8_t* data()     const { return m_Data.data(); }
-    uint8_t*       data()           { return m_Data.data(); }
+    size_t         bits_num()  const { return m_nBits; }
+    size_t         size()            { return (m_nBits < 8) ? 1 : 1 + (m_nBits - 1) / 8; }
+    const uint8_t* data()      const { return reinterpret_cast<const uint8_t*>(m_Words.data()); }
+    uint8_t*       data()            { return reinterpret_cast<uint8_t*>(m_Words.data()); }
+    size_t         words_num() const { return m_Words.size(); }
 
     /**
      * @brief Reallocates the container size for the number.
-     * 
+     *
      * @param nBits Desired number of bits of the stored number.
      * @return Size of the current container in bytes
      */
     size_t resize(size_t nBits) {
         m_nBits = nBits;
-        size_t nBytes;
-        if (m_nBits < 8) {
-            nBytes = 1;
-        } else {
-            nBytes = 1 + (m_nBits - 1) / 8;
-        }
-        m_Data.resize(nBytes);
-        return nBytes;
+        size_t nWords = (m_nBits < WORD_BITS) ? 1 : 1 + (m_nBits - 1) / WORD_BITS;
+        m_Words.resize(nWords, 0);
+        trim();
+        return size();
     }
 
     /**
      * @brief Returns true if a bit on specified position is set.
-     * 
+     *
      * @param pos Bit position starting from left
      * @return true if bit on the pos is set
      * @return false if bit on the pos is unset
      */
     bool operator[](size_t pos) const {
-        size_t byte = pos / 8, offset = pos % 8;
-        return (m_Data[byte] >> offset) & 0x1;
+        return (load(pos / WORD_BITS) >> (pos % WORD_BITS)) & 0x1;
+    }
+
+    bool test(size_t pos) const {
+        assert(pos < m_nBits);
+        return (*this)[pos];
+    }
+
+    Cbitset& set(size_t pos, bool value = true) {
+        assert(pos < m_nBits);
+        size_t i = pos / WORD_BITS;
+        uint64_t mask = 1ULL << (pos % WORD_BITS);
+        store(i, value ? (load(i) | mask) : (load(i) & ~mask));
+        return *this;
+    }
+
+    Cbitset& reset(size_t pos) { return set(pos, false); }
+
+    Cbitset& flip(size_t pos) {
+        assert(pos < m_nBits);
+        size_t i = pos / WORD_BITS;
+        store(i, load(i) ^ (1ULL << (pos % WORD_BITS)));
+        return *this;
     }
 
     /**
-     * @brief Returns a binary number as a string.
-     * 
+     * @brief Sets all bits.
+     */
+    Cbitset& set() {
+        std::fill(m_Words.begin(), m_Words.end(), ~0ULL);
+        trim();
+        return *this;
+    }
+
+    /**
+     * @brief Clears all bits.
+     */
+    Cbitset& reset() {
+        std::fill(m_Words.begin(), m_Words.end(), 0);
+        return *this;
+    }
+
+    /**
+     * @brief Returns the number of set bits.
+     */
+    size_t count() const {
+        size_t n = 0;
+        for (size_t i = 0; i < m_Words.size(); i++) {
+            n += detail::popcount64(m_Words[i]);
+        }
+        return n;
+    }
+
+    bool any() const {
+        for (size_t i = 0; i < m_Words.size(); i++) {
+            if (m_Words[i]) return true;
+        }
+        return false;
+    }
+
+    bool none() const { return !any(); }
+
+    /**
+     * @brief Returns the position of the lowest set bit.
+     *
+     * @return Bit position or npos if no bit is set
+     */
+    size_t find_first() const {
+        for (size_t i = 0; i < m_Words.size(); i++) {
+            uint64_t w = load(i);
+            if (w) {
+                return i * WORD_BITS + detail::ctz64(w);
+            }
+        }
+        return npos;
+    }
+
+    /**
+     * @brief Returns the position of the lowest set bit above pos.
+     *
+     * @param pos Position to start the search after
+     * @return Bit position or npos if no more bits are set
+     */
+    size_t find_next(size_t pos) const {
+        if (pos == npos || ++pos >= m_nBits) {
+            return npos;
+        }
+        size_t i = pos / WORD_BITS;
+        uint64_t w = load(i) & (~0ULL << (pos % WORD_BITS));
+        while (!w) {
+            if (++i == m_Words.size()) {
+                return npos;
+            }
+            w = load(i);
+        }
+        return i * WORD_BITS + detail::ctz64(w);
+    }
+
+    /*
+     * Bulk operations work on whole words. The operand may be of a different
+     * length: the missing bits of a shorter operand are treated as zeros.
+     */
+    Cbitset& operator&=(const Cbitset& rhs) {
+        size_t common = std::min(m_Words.size(), rhs.m_Words.size());
+        for (size_t i = 0; i < common; i++) {
+            m_Words[i] &= rhs.m_Words[i];
+        }
+        std::fill(m_Words.begin() + common, m_Words.end(), 0);
+        return *this;
+    }
+
+    Cbitset& operator|=(const Cbitset& rhs) {
+        size_t common = std::min(m_Words.size(), rhs.m_Words.size());
+        for (size_t i = 0; i < common; i++) {
+            m_Words[i] |= rhs.m_Words[i];
+        }
+        trim();
+        return *this;
+    }
+
+    Cbitset& operator^=(const Cbitset& rhs) {
+        size_t common = std::min(m_Words.size(), rhs.m_Words.size());
+        for (size_t i = 0; i < common; i++) {
+            m_Words[i] ^= rhs.m_Words[i];
+        }
+        trim();
+        return *this;
+    }
+
+    Cbitset operator~() const {
+        Cbitset res(*this);
+        for (size_t i = 0; i < res.m_Words.size(); i++) {
+            res.m_Words[i] = ~res.m_Words[i];
+        }
+        res.trim();
+        return res;
+    }
+
+    /**
+     * @brief Shifts bits towards higher positions. Bits shifted past
+     * bits_num() are lost.
+     */
+    Cbitset& operator<<=(size_t n) {
+        if (n >= m_nBits) {
+            return reset();
+        }
+        size_t shift = n / WORD_BITS, offset = n % WORD_BITS;
+        for (size_t i = m_Words.size(); i-- > 0;) {
+            uint64_t w = 0;
+            if (i >= shift) {
+                w = load(i - shift) << offset;
+                if (offset && i > shift) {
+                    w |= load(i - shift - 1) >> (WORD_BITS - offset);
+                }
+            }
+            store(i, w);
+        }
+        trim();
+        return *this;
+    }
+
+    /**
+     * @brief Shifts bits towards lower positions.
+     */
+    Cbitset& operator>>=(size_t n) {
+        if (n >= m_nBits) {
+            return reset();
+        }
+        size_t shift = n / WORD_BITS, offset = n % WORD_BITS;
+        size_t nWords = m_Words.size();
+        for (size_t i = 0; i < nWords; i++) {
+            uint64_t w = 0;
+            if (i + shift < nWords) {
+                w = load(i + shift) >> offset;
+                if (offset && i + shift + 1 < nWords) {
+                    w |= load(i + shift + 1) << (WORD_BITS - offset);
+                }
+            }
+            store(i, w);
+        }
+        return *this;
+    }
+
+    Cbitset operator<<(size_t n) const { Cbitset res(*this); res <<= n; return res; }
+    Cbitset operator>>(size_t n) const { Cbitset res(*this); res >>= n; return res; }
+
+    /**
+     * @brief Returns the number of characters written by to_chars().
+     *
+     * @param blk Size of the block of bits, see to_chars()
+     */
+    size_t chars_num(unsigned int blk = 4) const {
+        bool formatting = (blk > 0 && blk < m_nBits);
+        return m_nBits + (formatting ? m_nBits / blk : 0);
+    }
+
+    /**
+     * @brief Writes a binary number into the buffer [first, last) without
+     * any heap allocation. The output is not null-terminated.
+     *
+     * @param first Beginning of the output buffer
+     * @param last End of the output buffer
      * @param blk Sets the size of the block of bits between which a space
      * will be affixed for better visual perception.
-     * @return std::string 
+     * @return Pointer past the last written character or nullptr if the buffer
+     * is shorter than chars_num(blk). Nothing is written in that case.
      */
-    std::string to_string(unsigned int blk = 4) const {
-        std::stringstream ss;
-        bool formatting = (blk > 0 && blk < m_nBits) ? true : false;
-        for (size_t i = 0; i < m_nBits; i++) {
-            ss << ((*this)[m_nBits - i - 1] ? "1" : "0");
-            if (formatting && !((i+1) % blk)) {
-                ss << " ";
+    char* to_chars(char* first, char* last, unsigned int blk = 4) const {
+        if (static_cast<size_t>(last - first) < chars_num(blk)) {
+            return nullptr;
+        }
+        if (m_nBits == 0) {
+            return first;
+        }
+        const detail::bin_table& table = detail::bin_chars();
+        const uint8_t* bytes = data();
+        size_t top = (m_nBits - 1) / 8;
+        size_t head = m_nBits - top * 8; // bits of the most significant byte
+        bool formatting = (blk > 0 && blk < m_nBits);
+        if (!formatting) {
+            const char* src = table.digits[bytes[top]] + (8 - head);
+            std::memcpy(first, src, head);
+            first += head;
+            for (size_t i = top; i-- > 0;) {
+                std::memcpy(first, table.digits[bytes[i]], 8);
+                first += 8;
+            }
+            return first;
+        }
+        size_t left = blk; // characters until the next delimiter
+        for (size_t i = top + 1; i-- > 0;) {
+            const char* src = table.digits[bytes[i]];
+            size_t n = 8;
+            if (i == top) {
+                src += 8 - head;
+                n = head;
+            }
+            while (n) {
+                size_t k = std::min(n, left);
+                n -= k;
+                left -= k;
+                if (k == 8) {
+                    std::memcpy(first, src, 8);
+                    first += 8;
+                    src += 8;
+                } else {
+                    while (k--) {
+                        *first++ = *src++;
+                    }
+                }
+                if (!left) {
+                    *first++ = ' ';
+                    left = blk;
+                }
             }
         }
-        return ss.str();
+        return first;
+    }
+
+    /**
+     * @brief Returns a binary number as a string.
+     *
+     * @param blk Sets the size of the block of bits between which a space
+     * will be affixed for better visual perception.
+     * @return std::string
+     */
+    std::string to_string(unsigned int blk = 4) const {
+        std::string s(chars_num(blk), '0');
+        to_chars(&s[0], &s[0] + s.size(), blk);
+        return s;
     }
 
     unsigned long long to_udec() const {
@@ -126,6 +471,10 @@ public:
 
 }; // class Cbitset
 
+inline Cbitset operator&(Cbitset lhs, const Cbitset& rhs) { return lhs &= rhs; }
+inline Cbitset operator|(Cbitset lhs, const Cbitset& rhs) { return lhs |= rhs; }
+inline Cbitset operator^(Cbitset lhs, const Cbitset& rhs) { return lhs ^= rhs; }
+
 }
 
 #endif
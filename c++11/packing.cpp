@@ -1,15 +1,203 @@
 #include <iostream>
 #include <utility>
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <algorithm>
 #include <functional>
 #include <vector>
+#include <deque>
+#include <memory>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "whitespace.h"
 
 
 #define MASKED_SPACE ','
 
+/**
+ * @brief Ring of fixed-size package slots for scatter-gather sends
+ *
+ * The producer fills free slots with acquire()/commit(), the consumer takes
+ * ready slots as iovec batches with peek() (one slot per datagram for
+ * sendmmsg, or all of them for writev) and returns them with acknowledge().
+ * All memory is allocated once in the constructor.
+ */
+class CPackageRing
+{
+public:
+    CPackageRing(std::size_t nSlots, std::size_t slotSize)
+        : m_nSlots(std::max((std::size_t)1, nSlots))
+        , m_slotSize(std::max((std::size_t)1, slotSize))
+        , m_vData(m_nSlots * m_slotSize)
+        , m_vLength(m_nSlots, 0)
+        , m_nHead(0)
+        , m_nCount(0)
+    {
+    }
+
+    std::size_t slotSize() const { return m_slotSize; }
+    std::size_t slots() const { return m_nSlots; }
+    std::size_t ready() const { return m_nCount; }
+    std::size_t freeSlots() const { return m_nSlots - m_nCount; }
+
+    /**
+     * @brief Get the next free slot
+     *
+     * @return slotSize() bytes to write to or NULL if the ring is full
+     */
+    char* acquire()
+    {
+        if (m_nCount == m_nSlots)
+        {
+            return NULL;
+        }
+        return &m_vData[index(m_nCount) * m_slotSize];
+    }
+    /**
+     * @brief Mark the slot returned by acquire() as ready
+     */
+    void commit(std::size_t length)
+    {
+        m_vLength[index(m_nCount)] = std::min(length, m_slotSize);
+        ++m_nCount;
+    }
+    /**
+     * @brief Describe up to nMax ready slots, oldest first
+     *
+     * The slots stay in the ring until they are acknowledged.
+     *
+     * @return number of filled iovec entries
+     */
+    std::size_t peek(struct iovec* pIov, std::size_t nMax)
+    {
+        const std::size_t n = std::min(nMax, m_nCount);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const std::size_t slot = index(i);
+            pIov[i].iov_base = &m_vData[slot * m_slotSize];
+            pIov[i].iov_len = m_vLength[slot];
+        }
+        return n;
+    }
+    /**
+     * @brief Recycle the n oldest ready slots
+     */
+    void acknowledge(std::size_t n)
+    {
+        n = std::min(n, m_nCount);
+        m_nHead = (m_nHead + n) % m_nSlots;
+        m_nCount -= n;
+    }
+
+private:
+    std::size_t index(std::size_t i) const { return (m_nHead + i) % m_nSlots; }
+
+    std::size_t m_nSlots;
+    std::size_t m_slotSize;
+    std::vector<char> m_vData;
+    std::vector<std::size_t> m_vLength;
+    std::size_t m_nHead;    // oldest ready slot
+    std::size_t m_nCount;   // ready slots
+};
+
+/**
+ * @brief Fixed set of threads running queued tasks
+ *
+ * The threads are started in the constructor and joined in the destructor,
+ * after the queue is empty.
+ */
+class CWorkerPool
+{
+public:
+    explicit CWorkerPool(unsigned nThreads)
+        : m_bStop(false)
+    {
+        for (unsigned i = 0; i < std::max(1u, nThreads); ++i)
+        {
+            m_vThreads.push_back(std::thread(&CWorkerPool::run, this));
+        }
+    }
+    ~CWorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_bStop = true;
+        }
+        m_Ready.notify_all();
+        for (std::size_t i = 0; i < m_vThreads.size(); ++i)
+        {
+            m_vThreads[i].join();
+        }
+    }
+
+    /**
+     * @brief Queue fn and return the future of its result
+     */
+    template <typename F>
+    std::future<decltype(std::declval<F&>()())> submit(F fn)
+    {
+        typedef decltype(std::declval<F&>()()) result_type;
+        std::shared_ptr<std::packaged_task<result_type()>> pTask =
+            std::make_shared<std::packaged_task<result_type()>>(std::move(fn));
+        std::future<result_type> result = pTask->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Tasks.push_back([pTask]() { (*pTask)(); });
+        }
+        m_Ready.notify_one();
+        return result;
+    }
+
+private:
+    void run()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                while (!m_bStop && m_Tasks.empty())
+                {
+                    m_Ready.wait(lock);
+                }
+                if (m_Tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(m_Tasks.front());
+                m_Tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> m_vThreads;
+    std::deque<std::function<void()>> m_Tasks;
+    std::mutex m_Mutex;
+    std::condition_variable m_Ready;
+    bool m_bStop;
+};
+
 class CPacker
 {
 public:
@@ -21,22 +209,18 @@ public:
     {
         return [](std::string& s)
             {
-                const char whitespace[] {" \t\n"};
-                const std::size_t first(s.find_first_not_of(whitespace));
-                if (std::string::npos == first) { return; }
-                const std::size_t last(s.find_last_not_of(whitespace));
-                s = std::move(s.substr(first, (last - first + 1)));
+                const std::size_t first(Toolkit::find_first_not_space(s.data(), s.size()));
+                if (first == s.size()) { return; }
+                const std::size_t last(Toolkit::find_last_not_space(s.data(), s.size()));
+                s.erase(last + 1);
+                s.erase(0, first);
             };
     }
     static string_processing extra_space_remover()
     {
         return [](std::string& s)
             {
-                std::string sTmp;
-                std::unique_copy (s.begin(), s.end(),
-                                    std::back_insert_iterator<std::string>(sTmp),
-                                    [](char a,char b){ return isspace(a) && isspace(b);});
-                s = std::move(sTmp);
+                s.resize(Toolkit::collapse_spaces(&s[0], s.size()));
             };
     }
     static string_processing append_new_line()
@@ -54,10 +238,102 @@ public:
                 [](char c)->bool { return (isspace(c)); }, MASKED_SPACE);
         };
     }
-    
+
+    /*
+     * Compile-time stages for setPipeline(). They do the same as the helpers
+     * above, but the whole chain is fused into one in-place pass per line:
+     * bounds() narrows the range before the pass, step() sees every kept
+     * character and returns false to drop it, finish() runs after the pass.
+     * Stages with bounds() must come before stages with step().
+     */
+    struct Stage
+    {
+        void bounds(const char*&, const char*&) {}
+        bool step(char&) { return true; }
+        void finish(std::string&) {}
+    };
+    struct Trim : Stage
+    {
+        void bounds(const char*& first, const char*& last)
+        {
+            const std::size_t n = last - first;
+            const std::size_t b = Toolkit::find_first_not_space(first, n);
+            if (b == n) { return; } // nothing but whitespace, like trimmer()
+            last = first + Toolkit::find_last_not_space(first, n) + 1;
+            first += b;
+        }
+    };
+    struct CollapseSpaces : Stage
+    {
+        bool m_bSpace = false;
+        bool step(char& c)
+        {
+            const bool bSpace = isspace((unsigned char)c) != 0;
+            const bool bKeep = !(bSpace && m_bSpace);
+            m_bSpace = bSpace;
+            return bKeep;
+        }
+    };
+    struct MaskSpaces : Stage
+    {
+        bool step(char& c)
+        {
+            if (isspace((unsigned char)c)) { c = MASKED_SPACE; }
+            return true;
+        }
+    };
+    struct AppendNewLine : Stage
+    {
+        void finish(std::string& s) { s += '\n'; }
+    };
+
+    template <typename... Stages> struct Chain;
+
+    template <typename... Stages>
+    struct Pipeline
+    {
+        static void apply(std::string& s)
+        {
+            Chain<Stages...> chain;
+            s.resize(run(chain, &s[0], s.size()));
+            chain.finish(s);
+        }
+        /**
+         * @brief In-place pass over [s, s + n) without the finish() hooks
+         *
+         * @return New length
+         */
+        static std::size_t apply(char* s, std::size_t n)
+        {
+            Chain<Stages...> chain;
+            return run(chain, s, n);
+        }
+
+    private:
+        static std::size_t run(Chain<Stages...>& chain, char* s, std::size_t n)
+        {
+            const char* first = s;
+            const char* last = s + n;
+            chain.bounds(first, last);
+            char* out = s;
+            for (const char* it = first; it != last; ++it)
+            {
+                char c = *it;
+                if (chain.step(c)) { *out++ = c; }
+            }
+            return out - s;
+        }
+    };
+
     CPacker(const std::string& sTarget, bool bIsFilePath = true)
         : m_packageSize(1499)
+        ,m_nPending(0)
+        ,m_bEof(false)
         ,m_bFileStream(bIsFilePath)
+        ,m_fnPipeline(NULL)
+        ,m_nWorkers(1)
+        ,m_blockSize(1 << 20)
+        ,m_nLine(0)
     {
         if (isFileStream())
         {
@@ -70,7 +346,13 @@ public:
     }
     CPacker(std::size_t packageSize, const std::string& sTarget, bool bIsFilePath = true)
         : m_packageSize(packageSize)
+        ,m_nPending(0)
+        ,m_bEof(false)
         ,m_bFileStream(bIsFilePath)
+        ,m_fnPipeline(NULL)
+        ,m_nWorkers(1)
+        ,m_blockSize(1 << 20)
+        ,m_nLine(0)
     {
         m_packageSize = std::max((std::size_t)1, m_packageSize);
         if (isFileStream())
@@ -84,6 +366,7 @@ public:
     }
     virtual ~CPacker()
     {
+        waitBatch();
         if (m_File.is_open())
         {
             m_File.close();
@@ -96,31 +379,18 @@ public:
      */
     const char* getPackage()
     {
-        std::istream* pS = NULL;
-        if (isFileStream())
-        {
-            if (!m_File.is_open())
-            {
-                return NULL;
-            }
-            pS = static_cast<std::istream*>(&m_File);
-        }
-        else
+        if (stream() == NULL)
         {
-            pS = static_cast<std::istream*>(&m_sStream);
+            return NULL;
         }
 
         m_sBuffer = m_sResidue;
         m_sResidue.clear();
 
-        while (std::getline(*pS, m_sResidue))
-        {           
-            for (iterator it = m_vProcess.begin(); it != m_vProcess.end(); ++it)
-            {
-                (*it)(m_sResidue);
-            }
-
-            if ((m_sBuffer.size() + m_sResidue.size()) < m_packageSize)
+        while (nextLine(m_sResidue))
+        {
+            // a line longer than the package goes out as a package of its own
+            if (m_sBuffer.empty() || (m_sBuffer.size() + m_sResidue.size()) < m_packageSize)
             {
                 m_sBuffer.append(m_sResidue);
                 m_sResidue.clear();
@@ -139,6 +409,10 @@ public:
     }
     void Reset(const std::string& sTarget, bool bIsFilePath = true)
     {
+        waitBatch();
+        m_vLines.clear();
+        m_nLine = 0;
+        m_sTail.clear();
         m_bFileStream = bIsFilePath;
         if (isFileStream())
         {
@@ -159,6 +433,8 @@ public:
         }
         m_sBuffer.clear();
         m_sResidue.clear();
+        m_nPending = 0;
+        m_bEof = false;
     }
     bool isFileStream() const { return (m_bFileStream != false); }
     CPacker& addStringProcessing(string_processing&& p)
@@ -166,19 +442,772 @@ public:
         m_vProcess.push_back(std::move(p));
         return *this;
     }
+    /**
+     * @brief Set the fused processing pipeline, e.g.
+     * setPipeline<CPacker::Trim, CPacker::CollapseSpaces>()
+     *
+     * It runs on every line before the functions added by
+     * addStringProcessing().
+     */
+    template <typename... Stages>
+    CPacker& setPipeline()
+    {
+        m_fnPipeline = &Pipeline<Stages...>::apply;
+        return *this;
+    }
+    /**
+     * @brief Write packages into the free slots of the ring
+     *
+     * A package longer than a slot (a single long line) takes several
+     * slots in a row. The part of a package that does not fit the free
+     * slots is written by the next call.
+     *
+     * @return number of slots filled, 0 when the ring is full or the input
+     * is over, see eof()
+     */
+    std::size_t fillRing(CPackageRing& ring)
+    {
+        std::size_t nFilled = 0;
+        while (!m_bEof)
+        {
+            if (m_nPending == m_sBuffer.size())
+            {
+                if (getPackage() == NULL)
+                {
+                    m_sBuffer.clear();
+                    m_nPending = 0;
+                    m_bEof = true;
+                    break;
+                }
+                m_nPending = 0;
+            }
+            char* pSlot;
+            while (m_nPending < m_sBuffer.size() && (pSlot = ring.acquire()) != NULL)
+            {
+                const std::size_t n = std::min(ring.slotSize(), m_sBuffer.size() - m_nPending);
+                memcpy(pSlot, m_sBuffer.data() + m_nPending, n);
+                ring.commit(n);
+                m_nPending += n;
+                ++nFilled;
+            }
+            if (m_nPending < m_sBuffer.size())
+            {
+                break;
+            }
+        }
+        return nFilled;
+    }
+    /**
+     * @brief True when fillRing() has written the last package, the slots
+     * already in the ring still have to be sent
+     */
+    bool eof() const { return m_bEof; }
+    /**
+     * @brief Process lines on several threads
+     *
+     * The input is read in blocks of blockSize bytes, the lines of a block
+     * are split between nWorkers threads, and the next block is loaded while
+     * the packages of the current one are built. The threads are started
+     * here and kept until the packer is destroyed or set up again, the same
+     * threads load and process every block. Packages are the same as in
+     * the serial mode. All string processing functions must be safe to call
+     * from several threads at once, the helpers above are.
+     *
+     * Call it before the first getPackage().
+     *
+     * @param nWorkers number of threads, 0 or 1 for the serial mode
+     */
+    CPacker& setParallel(unsigned nWorkers, std::size_t blockSize = 1 << 20)
+    {
+        waitBatch();
+        m_nWorkers = std::max(1u, nWorkers);
+        m_blockSize = std::max((std::size_t)1, blockSize);
+        m_pPool.reset(m_nWorkers < 2 ? NULL : new CWorkerPool(m_nWorkers));
+        return *this;
+    }
 
 private:
+    std::istream* stream()
+    {
+        if (isFileStream())
+        {
+            return m_File.is_open() ? static_cast<std::istream*>(&m_File) : NULL;
+        }
+        return static_cast<std::istream*>(&m_sStream);
+    }
+
+    void process(std::string& sLine) const
+    {
+        if (m_fnPipeline)
+        {
+            m_fnPipeline(sLine);
+        }
+        for (std::vector<string_processing>::const_iterator it = m_vProcess.begin(); it != m_vProcess.end(); ++it)
+        {
+            (*it)(sLine);
+        }
+    }
+
+    /**
+     * @brief Get the next processed line
+     *
+     * @return false at the end of the input
+     */
+    bool nextLine(std::string& sLine)
+    {
+        if (m_nWorkers < 2)
+        {
+            if (!std::getline(*stream(), sLine))
+            {
+                return false;
+            }
+            process(sLine);
+            return true;
+        }
+
+        if (m_nLine == m_vLines.size())
+        {
+            m_vLines = m_Batch.valid() ? m_Batch.get() : loadBatch();
+            m_nLine = 0;
+            if (m_vLines.empty())
+            {
+                return false;
+            }
+            m_Batch = m_pPool->submit(std::bind(&CPacker::loadBatch, this));
+        }
+        sLine = std::move(m_vLines[m_nLine++]);
+        return true;
+    }
+
+    void waitBatch()
+    {
+        if (m_Batch.valid())
+        {
+            m_Batch.wait();
+            m_Batch = std::future<std::vector<std::string>>();
+        }
+    }
+
+    /**
+     * @brief Read the next block, split it into lines the way getline does
+     * and process them on the workers
+     */
+    std::vector<std::string> loadBatch()
+    {
+        std::vector<std::string> vLines;
+        std::istream* pS = stream();
+        if (pS == NULL)
+        {
+            return vLines;
+        }
+
+        m_sBlock.resize(m_blockSize);
+        while (vLines.empty())
+        {
+            pS->read(&m_sBlock[0], m_blockSize);
+            const std::size_t n = pS->gcount();
+            if (n == 0)
+            {
+                if (!m_sTail.empty())
+                {
+                    vLines.push_back(std::move(m_sTail));
+                    m_sTail.clear();
+                }
+                break;
+            }
+
+            const char* pBegin = m_sBlock.data();
+            const char* pEnd = pBegin + n;
+            const char* pLine = pBegin;
+            const char* pEol;
+            while ((pEol = static_cast<const char*>(memchr(pLine, '\n', pEnd - pLine))) != NULL)
+            {
+                if (m_sTail.empty())
+                {
+                    vLines.emplace_back(pLine, pEol);
+                }
+                else
+                {
+                    m_sTail.append(pLine, pEol);
+                    vLines.push_back(std::move(m_sTail));
+                    m_sTail.clear();
+                }
+                pLine = pEol + 1;
+            }
+            m_sTail.append(pLine, pEnd);
+        }
+
+        const std::size_t nParts = std::min<std::size_t>(m_nWorkers, vLines.size());
+        if (nParts == 0)
+        {
+            return vLines;
+        }
+        const std::size_t nPart = (vLines.size() + nParts - 1) / nParts;
+        auto work = [this, &vLines](std::size_t first, std::size_t last)
+            {
+                for (std::size_t i = first; i < last; ++i)
+                {
+                    process(vLines[i]);
+                }
+            };
+        // the loader takes one pool thread at most, the rest are free for the parts
+        std::vector<std::future<void>> vWorkers;
+        for (std::size_t first = nPart; first < vLines.size(); first += nPart)
+        {
+            vWorkers.push_back(m_pPool->submit(std::bind(work, first, std::min(first + nPart, vLines.size()))));
+        }
+        work(0, std::min(nPart, vLines.size()));
+        for (std::size_t i = 0; i < vWorkers.size(); ++i)
+        {
+            vWorkers[i].get();
+        }
+        return vLines;
+    }
+
     std::size_t m_packageSize;
+    std::size_t m_nPending;               // bytes of m_sBuffer already in the ring
+    bool m_bEof;                          // fillRing() reached the end of the input
     std::string m_sBuffer;
     std::string m_sResidue;
     std::ifstream m_File;
     std::istringstream m_sStream;
     bool m_bFileStream;
     std::vector<string_processing> m_vProcess;
+    void (*m_fnPipeline)(std::string&);   // fused stages, see setPipeline()
+
+    // parallel mode
+    unsigned m_nWorkers;
+    std::size_t m_blockSize;
+    std::string m_sBlock;                 // raw block, used by the loader only
+    std::string m_sTail;                  // unfinished line at the end of a block
+    std::vector<std::string> m_vLines;    // processed lines of the current block
+    std::size_t m_nLine;
+    std::future<std::vector<std::string>> m_Batch; // next block
+    std::unique_ptr<CWorkerPool> m_pPool;           // nWorkers threads, NULL in the serial mode
+};
+
+template <>
+struct CPacker::Chain<>
+{
+    void bounds(const char*&, const char*&) {}
+    bool step(char&) { return true; }
+    void finish(std::string&) {}
 };
 
+template <typename S, typename... Rest>
+struct CPacker::Chain<S, Rest...>
+{
+    S m_Head;
+    Chain<Rest...> m_Tail;
+
+    void bounds(const char*& first, const char*& last)
+    {
+        m_Head.bounds(first, last);
+        m_Tail.bounds(first, last);
+    }
+    bool step(char& c) { return m_Head.step(c) && m_Tail.step(c); }
+    void finish(std::string& s)
+    {
+        m_Head.finish(s);
+        m_Tail.finish(s);
+    }
+};
+
+#if __cplusplus >= 201703L
+
+/**
+ * @brief Packer over a memory-mapped file that hands out packages as
+ * std::string_view slices of the mapping
+ *
+ * Packages are built by the same rules as CPacker::getPackage() with
+ * append_new_line() as the last processing step, but every line keeps its
+ * own '\n' from the file, so without a pipeline nothing is copied at all.
+ * A pipeline set by setPipeline() may only shrink lines: it runs in place on
+ * a private copy-on-write mapping and the processed lines are moved down to
+ * stay contiguous. finish() hooks (AppendNewLine) are not used.
+ *
+ * The only copy is made when the file does not end with '\n': the last
+ * package then goes to a side buffer. A slice stays valid until the packer
+ * is reset or destroyed.
+ */
+class CMappedPacker
+{
+public:
+    explicit CMappedPacker(const std::string& sPath, std::size_t packageSize = 1499)
+        : m_packageSize(std::max((std::size_t)1, packageSize))
+        , m_pMap(NULL)
+        , m_mapSize(0)
+        , m_fnPipeline(NULL)
+    {
+        Reset(sPath);
+    }
+    ~CMappedPacker()
+    {
+        unmap();
+    }
+    CMappedPacker(const CMappedPacker&) = delete;
+    CMappedPacker& operator=(const CMappedPacker&) = delete;
+
+    bool isOpen() const { return m_pMap != NULL || m_bEmpty; }
+
+    void Reset(const std::string& sPath)
+    {
+        unmap();
+        m_bEmpty = false;
+        int fd = open(sPath.c_str(), O_RDONLY);
+        if (fd >= 0)
+        {
+            struct stat st;
+            if (fstat(fd, &st) == 0)
+            {
+                m_mapSize = st.st_size;
+                m_bEmpty = (m_mapSize == 0);
+                if (!m_bEmpty)
+                {
+                    void* p = mmap(NULL, m_mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+                    if (p != MAP_FAILED)
+                    {
+                        m_pMap = static_cast<char*>(p);
+                        madvise(p, m_mapSize, MADV_SEQUENTIAL);
+                    }
+                }
+            }
+            close(fd);
+        }
+        m_pRead = m_pWrite = m_pMap;
+        m_pEnd = m_pMap + (m_pMap ? m_mapSize : 0);
+        m_Residue = std::string_view();
+        m_sTail.clear();
+        m_sSide.clear();
+    }
+
+    template <typename... Stages>
+    CMappedPacker& setPipeline()
+    {
+        m_fnPipeline = &CPacker::Pipeline<Stages...>::apply;
+        return *this;
+    }
+
+    /**
+     * @brief Get the next package
+     *
+     * @return Slice of the mapping or an empty view at the end
+     */
+    std::string_view getPackage()
+    {
+        std::string_view package = m_Residue;
+        m_Residue = std::string_view();
+
+        std::string_view line;
+        while (nextLine(line))
+        {
+            if (package.empty() || (package.size() + line.size()) < m_packageSize)
+            {
+                if (package.empty())
+                {
+                    package = line;
+                }
+                else if (package.data() + package.size() == line.data())
+                {
+                    package = std::string_view(package.data(), package.size() + line.size());
+                }
+                else
+                {
+                    // the unterminated last line lives in m_sTail
+                    m_sSide.assign(package.data(), package.size());
+                    m_sSide.append(line.data(), line.size());
+                    package = m_sSide;
+                }
+            }
+            else
+            {
+                m_Residue = line;
+                break;
+            }
+        }
+        return package;
+    }
+
+private:
+    void unmap()
+    {
+        if (m_pMap != NULL)
+        {
+            munmap(m_pMap, m_mapSize);
+            m_pMap = NULL;
+        }
+    }
+
+    /**
+     * @brief Process the next line in place and return it with its '\n'
+     */
+    bool nextLine(std::string_view& line)
+    {
+        if (m_pRead == m_pEnd)
+        {
+            return false;
+        }
+        char* pEol = static_cast<char*>(memchr(m_pRead, '\n', m_pEnd - m_pRead));
+        std::size_t n = (pEol ? pEol : m_pEnd) - m_pRead;
+        if (m_fnPipeline)
+        {
+            n = m_fnPipeline(m_pRead, n);
+        }
+
+        if (pEol == NULL)
+        {
+            m_sTail.assign(m_pRead, n);
+            m_sTail += '\n';
+            m_pRead = m_pEnd;
+            line = m_sTail;
+            return true;
+        }
+
+        if (m_pWrite != m_pRead)
+        {
+            memmove(m_pWrite, m_pRead, n);
+            m_pWrite[n] = '\n';
+        }
+        else if (n != (std::size_t)(pEol - m_pRead))
+        {
+            m_pWrite[n] = '\n';
+        }
+        line = std::string_view(m_pWrite, n + 1);
+        m_pWrite += n + 1;
+        m_pRead = pEol + 1;
+        return true;
+    }
+
+    std::size_t m_packageSize;
+    char* m_pMap;
+    std::size_t m_mapSize;
+    bool m_bEmpty;
+    char* m_pRead;                  // next unprocessed byte
+    char* m_pWrite;                 // end of the processed lines
+    char* m_pEnd;
+    std::string_view m_Residue;     // line that did not fit the last package
+    std::string m_sTail;            // last line when the file has no final '\n'
+    std::string m_sSide;            // last package when it includes m_sTail
+    std::size_t (*m_fnPipeline)(char*, std::size_t);
+};
+
+/**
+ * @brief Compare CMappedPacker with CPacker on the same file
+ */
+bool checkMapped(const std::string& sText, std::size_t packageSize, bool bPipeline)
+{
+    const std::string sPath = "packing_mapped.txt";
+    {
+        std::ofstream out(sPath, std::ios::binary);
+        out << sText;
+    }
+
+    CPacker packer(packageSize, sPath, true);
+    CMappedPacker mapped(sPath, packageSize);
+    if (bPipeline)
+    {
+        packer.addStringProcessing(CPacker::trimmer())
+              .addStringProcessing(CPacker::extra_space_remover())
+              .addStringProcessing(CPacker::space_masking());
+        mapped.setPipeline<CPacker::Trim, CPacker::CollapseSpaces, CPacker::MaskSpaces>();
+    }
+    packer.addStringProcessing(CPacker::append_new_line());
+
+    bool bSame = true;
+    for (;;)
+    {
+        const char* a = packer.getPackage();
+        std::string_view b = mapped.getPackage();
+        if (a == NULL || b.empty())
+        {
+            bSame = (a == NULL && b.empty());
+            break;
+        }
+        if (b != a)
+        {
+            bSame = false;
+            break;
+        }
+    }
+    remove(sPath.c_str());
+    return bSame;
+}
+
+#endif
+
+/**
+ * @brief Pack the same text serially and in parallel and compare the output
+ */
+bool checkParallel(const std::string& sText, std::size_t packageSize, unsigned nWorkers, std::size_t blockSize)
+{
+    CPacker serial(packageSize, sText, false);
+    CPacker parallel(packageSize, sText, false);
+    CPacker* packers[] = { &serial, &parallel };
+    for (CPacker* p : packers)
+    {
+        p->addStringProcessing(CPacker::trimmer())
+          .addStringProcessing(CPacker::extra_space_remover())
+          .addStringProcessing(CPacker::space_masking())
+          .addStringProcessing(CPacker::append_new_line());
+    }
+    parallel.setParallel(nWorkers, blockSize);
+
+    for (;;)
+    {
+        const char* a = serial.getPackage();
+        const char* b = parallel.getPackage();
+        if (a == NULL || b == NULL)
+        {
+            return a == b;
+        }
+        if (strcmp(a, b) != 0)
+        {
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief Send packages from a ring over loopback UDP with sendmmsg() and
+ * compare the datagrams with the packages of the serial packer
+ *
+ * With bPartial every sendmmsg() is given only a part of the ready slots,
+ * as when the socket buffer is full, so the rest has to wait in the ring
+ * for the next call.
+ */
+bool checkRing(const std::string& sText, std::size_t packageSize, std::size_t nSlots, bool bPartial = false)
+{
+    int rx = socket(AF_INET, SOCK_DGRAM, 0);
+    int tx = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (rx < 0 || tx < 0
+        || bind(rx, (struct sockaddr*)&addr, sizeof(addr)) != 0
+        || getsockname(rx, (struct sockaddr*)&addr, &addrLen) != 0
+        || connect(tx, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        std::cerr << "loopback UDP is not available" << std::endl;
+        close(rx);
+        close(tx);
+        return true;
+    }
+
+    CPacker expected(packageSize, sText, false);
+    CPacker packer(packageSize, sText, false);
+    CPackageRing ring(nSlots, packageSize);
+    std::vector<struct iovec> vIov(nSlots);
+    std::vector<struct mmsghdr> vMsg(nSlots);
+    std::vector<char> vRecv(packageSize + 1);
+
+    std::string sExpected;      // current expected package, cut to slots
+    std::size_t nExpectedOff = 0;
+    bool bSame = true;
+    unsigned seed = (unsigned)(nSlots * 31 + packageSize);
+    for (;;)
+    {
+        packer.fillRing(ring);
+        if (ring.ready() == 0 && packer.eof())
+        {
+            break;
+        }
+        std::size_t n = ring.peek(vIov.data(), vIov.size());
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            memset(&vMsg[i], 0, sizeof(vMsg[i]));
+            vMsg[i].msg_hdr.msg_iov = &vIov[i];
+            vMsg[i].msg_hdr.msg_iovlen = 1;
+        }
+        if (bPartial)
+        {
+            seed = seed * 1103515245 + 12345;
+            n = 1 + (seed >> 16) % n;
+        }
+        const int nSent = sendmmsg(tx, vMsg.data(), n, 0);
+        if (nSent <= 0)
+        {
+            bSame = false;
+            break;
+        }
+
+        for (int i = 0; i < nSent && bSame; ++i)
+        {
+            const ssize_t nRecv = recv(rx, vRecv.data(), vRecv.size(), 0);
+            if (nExpectedOff == sExpected.size())
+            {
+                const char* p = expected.getPackage();
+                sExpected = p ? p : "";
+                nExpectedOff = 0;
+            }
+            const std::size_t nPart = std::min(packageSize, sExpected.size() - nExpectedOff);
+            bSame = nRecv == (ssize_t)nPart && memcmp(vRecv.data(), sExpected.data() + nExpectedOff, nPart) == 0;
+            nExpectedOff += nPart;
+        }
+        ring.acknowledge(nSent);
+        if (!bSame)
+        {
+            break;
+        }
+    }
+    bSame = bSame && nExpectedOff == sExpected.size() && expected.getPackage() == NULL;
+
+    close(rx);
+    close(tx);
+    return bSame;
+}
+
+std::string makeText(std::size_t nLines, unsigned seed)
+{
+    const char* words[] = { "alpha", "beta", "  gamma", "\tdelta ", "", "   ", "epsilon\t\t", "zeta  eta" };
+    std::string sText;
+    for (std::size_t i = 0; i < nLines; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        unsigned nWords = (seed >> 16) % 12;
+        if ((seed >> 8) % 97 == 0)
+        {
+            nWords = 400; // longer than a package
+        }
+        for (unsigned w = 0; w < nWords; ++w)
+        {
+            seed = seed * 1103515245 + 12345;
+            sText += words[(seed >> 16) % 8];
+            sText += ' ';
+        }
+        sText += '\n';
+    }
+    sText += "last line without a new line";
+    return sText;
+}
+
+
+/**
+ * @brief Compare the fused pipeline with the std::function helpers line by
+ * line and measure both
+ */
+bool checkPipeline(const std::string& sText)
+{
+    std::vector<CPacker::string_processing> vHelpers = {
+        CPacker::trimmer(), CPacker::extra_space_remover(),
+        CPacker::space_masking(), CPacker::append_new_line()
+    };
+    typedef CPacker::Pipeline<CPacker::Trim, CPacker::CollapseSpaces,
+                              CPacker::MaskSpaces, CPacker::AppendNewLine> Fused;
+
+    std::vector<std::string> vLines;
+    std::istringstream in(sText);
+    std::string sLine;
+    while (std::getline(in, sLine))
+    {
+        vLines.push_back(sLine);
+    }
+    vLines.push_back("");
+    vLines.push_back(" \t\n ");
+    vLines.push_back("\r\v x \f\r");
+
+    for (const std::string& sOrig : vLines)
+    {
+        std::string a = sOrig, b = sOrig;
+        for (auto& f : vHelpers) { f(a); }
+        Fused::apply(b);
+        if (a != b)
+        {
+            std::cerr << "fused pipeline differs on \"" << sOrig << "\"" << std::endl;
+            return false;
+        }
+    }
+
+    std::size_t nTotal = 0;
+    std::vector<std::string> vWork;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < 10; ++r)
+    {
+        vWork = vLines;
+        for (std::string& s : vWork) { for (auto& f : vHelpers) { f(s); } nTotal += s.size(); }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (int r = 0; r < 10; ++r)
+    {
+        vWork = vLines;
+        for (std::string& s : vWork) { Fused::apply(s); nTotal += s.size(); }
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    const double nLines = 10.0 * vLines.size();
+    std::cerr << "std::function chain: " << std::chrono::duration<double, std::nano>(t1 - t0).count() / nLines
+              << " ns/line, fused pipeline: " << std::chrono::duration<double, std::nano>(t2 - t1).count() / nLines
+              << " ns/line (" << nTotal << ")" << std::endl;
+    return true;
+}
+
 int main()
 {
+    if (!checkPipeline(makeText(100000, 3)))
+    {
+        return 1;
+    }
+
+    for (unsigned seed = 1; seed <= 20; ++seed)
+    {
+        const std::string sText = makeText(2000 + seed * 37, seed);
+        for (std::size_t blockSize : { (std::size_t)1, (std::size_t)7, (std::size_t)4096, (std::size_t)1 << 20 })
+        {
+            if (!checkParallel(sText, 100 + seed * 50, 1 + seed % 4, blockSize))
+            {
+                std::cerr << "parallel packer differs: seed " << seed << ", block " << blockSize << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    for (std::size_t nSlots : { (std::size_t)1, (std::size_t)3, (std::size_t)16 })
+    {
+        if (!checkRing(makeText(3000, 5), 200, nSlots) || !checkRing(makeText(3000, 6), 1499, nSlots)
+            || !checkRing(makeText(3000, 7), 200, nSlots, true) || !checkRing(makeText(3000, 8), 64, nSlots, true))
+        {
+            std::cerr << "package ring differs, " << nSlots << " slots" << std::endl;
+            return 1;
+        }
+    }
+
+#if __cplusplus >= 201703L
+    const std::string vMapped[] = {
+        makeText(3000, 11), makeText(3000, 12) + "\n", "", "\n", "one line", "\n\n  \t\n x  y \n"
+    };
+    for (const std::string& sText : vMapped)
+    {
+        for (std::size_t packageSize : { (std::size_t)1, (std::size_t)64, (std::size_t)1499 })
+        {
+            if (!checkMapped(sText, packageSize, false) || !checkMapped(sText, packageSize, true))
+            {
+                std::cerr << "mapped packer differs, package size " << packageSize << std::endl;
+                return 1;
+            }
+        }
+    }
+#endif
+
+    const std::string sBig = makeText(400000, 7);
+    for (unsigned nWorkers : { 1u, std::max(2u, std::thread::hardware_concurrency()) })
+    {
+        CPacker p(sBig, false);
+        p.addStringProcessing(CPacker::trimmer())
+         .addStringProcessing(CPacker::extra_space_remover())
+         .addStringProcessing(CPacker::space_masking())
+         .addStringProcessing(CPacker::append_new_line());
+        p.setParallel(nWorkers);
+        std::size_t nPackages = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        while (p.getPackage() != NULL)
+        {
+            ++nPackages;
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        std::cerr << nWorkers << " worker(s): " << nPackages << " packages in " << secs << " s" << std::endl;
+    }
+
     const char* pack;
     CPacker f("test.txt",true);
     
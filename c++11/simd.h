@@ -0,0 +1,38 @@
+#ifndef TOOLKIT_SIMD_H
+#define TOOLKIT_SIMD_H
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define TOOLKIT_X86 1
+#include <immintrin.h>
+#endif
+
+namespace Toolkit {
+
+/**
+ * @brief Instruction sets used by the SIMD kernels.
+ */
+enum class SimdLevel {
+    eSCALAR = 0,
+    eSSE2,
+    eAVX2
+};
+
+/**
+ * @brief Returns the best instruction set supported by the running CPU.
+ * Detection is done once.
+ */
+inline SimdLevel simd_level() {
+    static const SimdLevel level = []() {
+#ifdef TOOLKIT_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return SimdLevel::eAVX2;
+        if (__builtin_cpu_supports("sse2")) return SimdLevel::eSSE2;
+#endif
+        return SimdLevel::eSCALAR;
+    }();
+    return level;
+}
+
+}
+
+#endif
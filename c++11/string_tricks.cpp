@@ -4,6 +4,7 @@
  * @details 
  * В этом файле показаны некоторые общие приемы работы со строками.
  * Компилируйте этот файл с флагом --std=c++17 или --std=gnu++17.
+ * С ключом -b программа вместо примеров только замеряет скорость.
  * @version 0.1
  * @date 2019-07-03
  * 
@@ -19,6 +20,14 @@
 #include <algorithm>
 #include <cctype>
 #include <string_view>
+#include <sstream>
+#include <cstring>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <charconv>
+
+#include "whitespace.h"
 
 using namespace std;
 
@@ -34,13 +43,17 @@ enum eSide {
     eSURROUND
 };
 
+/*
+ * Пробельные символы ищутся не по одному, а блоками по 16-32 байта с помощью
+ * SIMD-инструкций (см. whitespace.h). Набор пробельных символов тот же: " \t\n".
+ */
+
 string trim(const string &s, eSide where = eSURROUND)
 {
-    const char whitespace[] {" \t\n"};
-    const size_t first(s.find_first_not_of(whitespace));
-    if (string::npos == first) { return {}; }
+    const size_t first(Toolkit::find_first_not_space(s.data(), s.size()));
+    if (first == s.size()) { return {}; }
     if (where == eLEFT) { return s.substr(first,s.size()); }
-    const size_t last(s.find_last_not_of(whitespace));
+    const size_t last(Toolkit::find_last_not_space(s.data(), s.size()));
     if (where == eRIGHT) { return s.substr(0, last + 1); }
     return s.substr(first, (last - first + 1));
 }
@@ -59,13 +72,13 @@ string_view& fast_trim(string_view&& v, eSide where = eSURROUND)
 {
     if (where == eSURROUND || where == eLEFT)
     {
-        const auto first(v.find_first_not_of(" \t\n"));
-        v.remove_prefix(min(first, v.size()));
+        const auto first(Toolkit::find_first_not_space(v.data(), v.size()));
+        v.remove_prefix(first);
     }
     if (where == eSURROUND || where == eRIGHT)
     {
-        const auto last(v.find_last_not_of(" \t\n"));
-        if (last != string_view::npos)
+        const auto last(Toolkit::find_last_not_space(v.data(), v.size()));
+        if (last != v.size())
         {
             v.remove_suffix(v.size() - last - 1);
         }
@@ -99,25 +112,115 @@ void parse_input_stream(char delim = ',')
 }
 
 /*
- * На практике часто нужно обрабатывать входные файлы с текстовым наполнением. Типовой задачей
- * является подсчет слов в тексте. Важно в этом примере увидеть не как считать слова, а как можно
- * использовать потоки ввода для разбиения большого текста на смысловые части.
+ * Потоки удобны, но медленны: на каждый токен создается строка, а каждый символ
+ * проходит через механизм локалей. Если текст уже лежит в памяти, его можно
+ * разбирать без копирования, выдавая токены как string_view.
+ *
+ * token_splitter делит буфер по разделителю так же, как parse_input_stream():
+ * пробелы в начале токена пропускаются, пустой токен завершает разбор.
+ * Разделитель ищется функцией memchr, которая в стандартной библиотеке
+ * реализована на SIMD-инструкциях.
  */
 
-template<typename T>
-auto get_count_executor(T& inpStream) {
-    return [](T& inpStream) -> size_t {
-        return distance(istream_iterator<string>{inpStream}, {});
-        /*
-         * distance принимает два итератора и возвращает число перемещений с первого
-         * на второй. В данном случае количество слов подсчитывается за счет того,
-         * что мы передаем итератор потока, который начинает с начала потока, и вторым
-         * аргументом итератор end. Так как итератор istream_iterator однонаправленный,
-         * получается, что своим перемещением он посчитает количество слов.
-         */
+class token_splitter
+{
+public:
+    token_splitter(string_view buffer, char delim = ',')
+        : m_rest(buffer), m_delim(delim) {}
+
+    bool next(string_view& token)
+    {
+        m_rest.remove_prefix(Toolkit::find_first_not_space(m_rest.data(), m_rest.size(),
+                                                           Toolkit::SpaceSet::eISSPACE));
+        const char* p = static_cast<const char*>(memchr(m_rest.data(), m_delim, m_rest.size()));
+        const size_t len = p ? p - m_rest.data() : m_rest.size();
+        token = m_rest.substr(0, len);
+        m_rest.remove_prefix(p ? len + 1 : len);
+        return !token.empty();
+    }
+
+private:
+    string_view m_rest;
+    char m_delim;
+};
+
+void parse_buffer(string_view buffer, char delim = ',')
+{
+    token_splitter tokens(buffer, delim);
+    for (string_view s; tokens.next(s);)
+    {
+        cout << "Parsed token: \"" << s << "\"" << endl;
+    }
+}
+
+/*
+ * word_splitter выдает слова так же, как istream_iterator<string>: словом
+ * считается последовательность символов без пробельных (isspace). Границы слов
+ * ищутся блоками по 16-32 байта (см. whitespace.h).
+ */
+
+class word_splitter
+{
+public:
+    explicit word_splitter(string_view buffer) : m_rest(buffer) {}
+
+    bool next(string_view& word)
+    {
+        m_rest.remove_prefix(Toolkit::find_first_not_space(m_rest.data(), m_rest.size(),
+                                                           Toolkit::SpaceSet::eISSPACE));
+        if (m_rest.empty()) { return false; }
+        word = m_rest.substr(0, Toolkit::find_first_space(m_rest.data(), m_rest.size()));
+        m_rest.remove_prefix(word.size());
+        return true;
+    }
+
+private:
+    string_view m_rest;
+};
+
+/*
+ * Чтобы посчитать слова, их даже не нужно выделять: достаточно посчитать
+ * переходы от пробельного символа к непробельному. Большой буфер делится на
+ * части между потоками. Граница части сдвигается вперед до ближайшего
+ * пробельного символа, чтобы ни одно слово не оказалось разрезанным.
+ */
+
+size_t count_words(string_view text, unsigned threads = thread::hardware_concurrency())
+{
+    const size_t min_part = 1 << 20;
+    threads = max(1u, min<unsigned>(threads, text.size() / min_part));
+
+    vector<size_t> bounds {0};
+    for (unsigned i = 1; i < threads; i++)
+    {
+        size_t pos = max(bounds.back(), text.size() / threads * i);
+        pos += Toolkit::find_first_space(text.data() + pos, text.size() - pos);
+        bounds.push_back(pos);
+    }
+    bounds.push_back(text.size());
+
+    auto count = [text](size_t first, size_t last) {
+        return Toolkit::count_words(text.data() + first, last - first);
     };
+    vector<future<size_t>> parts;
+    for (unsigned i = 1; i < threads; i++)
+    {
+        parts.push_back(async(launch::async, count, bounds[i], bounds[i + 1]));
+    }
+    size_t counter = count(bounds[0], bounds[1]);
+    for (auto& part : parts)
+    {
+        counter += part.get();
+    }
+    return counter;
 }
 
+/*
+ * На практике часто нужно обрабатывать входные файлы с текстовым наполнением. Типовой задачей
+ * является подсчет слов в тексте. Важно в этом примере увидеть не как считать слова, а как можно
+ * использовать потоки ввода для разбиения большого текста на смысловые части.
+ */
+
 void word_counter(int argc, char* argv[]) {
     size_t counter = 0;
     /*
@@ -126,14 +229,39 @@ void word_counter(int argc, char* argv[]) {
      * Если пользователь передал что-то аргументом, то мы полагаем, что это файл, иначе используем
      * стандартный поток ввода.
      */
+    /*
+     * Поток здесь используется только для того, чтобы прочитать текст в память
+     * одним блоком, а слова считает count_words().
+     */
+    string text;
     if (argc == 2) {
-        ifstream ifs {argv[1]};
-        counter = get_count_executor(ifs)(ifs);
+        ifstream ifs {argv[1], ios::binary};
+        if (!ifs.is_open()) {
+            cerr << argv[1] << ": cannot open file" << endl;
+            return;
+        }
+        /*
+         * Размер известен только у обычного файла. У канала или /dev/stdin
+         * tellg() возвращает -1, и такой поток читается до конца как cin.
+         */
+        ifs.seekg(0, ios::end);
+        streamoff size = ifs.tellg();
+        if (size >= 0) {
+            text.resize(size);
+            ifs.seekg(0);
+            ifs.read(&text[0], text.size());
+            text.resize(ifs.gcount());
+        }
+        else {
+            ifs.clear();
+            text.assign(istreambuf_iterator<char>{ifs}, {});
+        }
     }
     else {
         cout << "Please type text. Press Ctrl+D to stop entering" << endl;
-        counter = get_count_executor(cin)(cin);
+        text.assign(istreambuf_iterator<char>{cin}, {});
     }
+    counter = count_words(text);
     cout << "Count result: " << counter << endl;
 }
 
@@ -165,8 +293,279 @@ istream& operator>>(istream& is, city& city) {
        return is;
 }
 
+/*
+ * Самопроверка векторных ядер whitespace.h: каждый уровень, доступный
+ * процессору, сравнивается со скалярным на случайных строках. Длины вокруг
+ * 16 и 32 байт проверяют переход на скалярный хвост, отдельно проверяются
+ * строки из одних пробелов и строки без пробелов.
+ */
+bool check_whitespace()
+{
+    using Toolkit::SimdLevel;
+    using Toolkit::SpaceSet;
+    const size_t edges[] = { 0, 1, 15, 16, 17, 31, 32, 33, 47, 48, 63, 64, 65, 95, 96, 97, 127, 128, 129 };
+    const char alphabet[] = { ' ', '\t', '\n', '\v', '\f', '\r', '\b', '\x0e', 'a', 'z', '\x80', '\xff' };
+    unsigned seed = 1;
+    auto next = [&seed]() { seed = seed * 1103515245 + 12345; return seed >> 16; };
+
+    for (int level = (int)SimdLevel::eSSE2; level <= (int)Toolkit::simd_level(); level++)
+    {
+        for (size_t round = 0; round < 4000; round++)
+        {
+            const size_t nEdges = sizeof(edges) / sizeof(edges[0]);
+            size_t n = edges[round % nEdges];
+            if (round >= 4 * nEdges) n = next() % 300;
+            // по кругу: одни пробелы, без пробелов, редкие пробелы, случайные символы
+            string text(n, ' ');
+            for (char& c : text)
+            {
+                switch (round % 4)
+                {
+                case 0: c = alphabet[next() % 6]; break;
+                case 1: c = alphabet[6 + next() % 6]; break;
+                case 2: c = next() % 16 ? alphabet[6 + next() % 6] : alphabet[next() % 6]; break;
+                default: c = alphabet[next() % sizeof(alphabet)]; break;
+                }
+            }
+            const SpaceSet set = next() % 2 ? SpaceSet::eISSPACE : SpaceSet::eBLANK;
+            const bool prev = next() % 2;
+            const SimdLevel simd = (SimdLevel)level, scalar = SimdLevel::eSCALAR;
+            const char* str = text.data();
+
+            string a = text, b = text;
+            size_t na = Toolkit::collapse_spaces(&a[0], n, set, scalar);
+            size_t nb = Toolkit::collapse_spaces(&b[0], n, set, simd);
+            bool same = Toolkit::find_first_not_space(str, n, set, scalar) == Toolkit::find_first_not_space(str, n, set, simd)
+                && Toolkit::find_last_not_space(str, n, set, scalar) == Toolkit::find_last_not_space(str, n, set, simd)
+                && Toolkit::find_first_space(str, n, set, scalar) == Toolkit::find_first_space(str, n, set, simd)
+                && Toolkit::count_words(str, n, set, prev, scalar) == Toolkit::count_words(str, n, set, prev, simd)
+                && na == nb && a.compare(0, na, b, 0, nb) == 0;
+            if (!same)
+            {
+                cout << "whitespace: level " << level << " differs from scalar, " << n << " bytes" << endl;
+                return false;
+            }
+        }
+    }
+    cout << "whitespace: SIMD kernels up to level " << (int)Toolkit::simd_level() << " match scalar" << endl;
+    return true;
+}
+
+/*
+ * Сравнение скорости: подсчет слов через istream_iterator, через word_splitter
+ * и через count_words() на нескольких потоках.
+ */
+void bench_tokenizers()
+{
+    string text;
+    unsigned seed = 1;
+    while (text.size() < (32 << 20))
+    {
+        seed = seed * 1103515245 + 12345;
+        text.append((seed >> 16) % 2 ? "lorem ipsum\tdolor  sit amet,\n" : " consectetur\t adipiscing elit ");
+    }
+
+    auto measure = [](const char* name, auto&& fn) {
+        auto t0 = chrono::steady_clock::now();
+        size_t words = fn();
+        chrono::duration<double> t = chrono::steady_clock::now() - t0;
+        cout << left << setw(22) << name << words << " words, " << t.count() * 1000 << " ms" << endl;
+        return words;
+    };
+    size_t a = measure("istream_iterator:", [&text]() {
+        istringstream is(text);
+        /*
+         * distance принимает два итератора и возвращает число перемещений с первого
+         * на второй. Итератор istream_iterator<string> за каждое перемещение читает
+         * из потока одно слово, поэтому число перемещений до итератора end и есть
+         * количество слов.
+         */
+        return (size_t)distance(istream_iterator<string>{is}, {});
+    });
+    size_t b = measure("word_splitter:", [&text]() {
+        word_splitter words(text);
+        size_t counter = 0;
+        for (string_view w; words.next(w);) { counter++; }
+        return counter;
+    });
+    size_t c = measure("count_words:", [&text]() {
+        return count_words(text, max(4u, thread::hardware_concurrency()));
+    });
+    if (a != b || a != c) { cout << "Word counts differ!" << endl; }
+}
+
+/*
+ * Для больших объемов данных удобнее разбирать записи city прямо из буфера.
+ * Числа читаются функцией from_chars: она не использует локали, не бросает
+ * исключений и не выделяет память. Записи складываются по столбцам: все имена
+ * лежат в одной строке, а числа - в отдельных массивах. Ошибочная запись не
+ * останавливает разбор, а попадает в список ошибок с номером строки.
+ */
+
+struct city_columns
+{
+    string names;                   // имена записей подряд
+    vector<size_t> name_offsets {0}; // начало каждого имени в names и конец последнего
+    vector<size_t> population;
+    vector<double> latitude;
+    vector<double> longitude;
+
+    size_t size() const { return population.size(); }
+    string_view name(size_t i) const
+    {
+        return string_view(names).substr(name_offsets[i], name_offsets[i + 1] - name_offsets[i]);
+    }
+    size_t memory() const
+    {
+        return names.capacity() + name_offsets.capacity() * sizeof(size_t)
+             + population.capacity() * sizeof(size_t)
+             + (latitude.capacity() + longitude.capacity()) * sizeof(double);
+    }
+};
+
+struct parse_error
+{
+    size_t line;        // номер строки, начиная с 1
+    const char* reason;
+};
+
+/*
+ * Формат тот же, что у operator>>: строка с именем (пробелы перед ним и пустые
+ * строки пропускаются) и строка "population latitude longitude". Если вторая
+ * строка не разобралась, разбор продолжается со строки, следующей за именем.
+ */
+size_t parse_cities(string_view buffer, city_columns& out, vector<parse_error>& errors)
+{
+    const char* p = buffer.data();
+    const char* const end = p + buffer.size();
+    size_t line = 1;
+
+    auto line_end = [end](const char* from) {
+        const char* eol = static_cast<const char*>(memchr(from, '\n', end - from));
+        return eol ? eol : end;
+    };
+    auto skip_blank = [end](const char* from) {
+        while (from != end && (*from == ' ' || *from == '\t')) { from++; }
+        return from;
+    };
+
+    size_t parsed = 0;
+    while (true)
+    {
+        // пропускаем пробелы и пустые строки, как is >> ws
+        while (p != end && isspace((unsigned char)*p))
+        {
+            line += (*p++ == '\n');
+        }
+        if (p == end) { break; }
+
+        const size_t name_line = line;
+        const char* name_end = line_end(p);
+        const char* q = (name_end == end) ? end : name_end + 1;
+
+        size_t pop = 0;
+        double lat = 0, lon = 0;
+        const char* reason = nullptr;
+        if (q == end)
+        {
+            reason = "no population line";
+        }
+        else
+        {
+            const char* eol = line_end(q);
+            const char* f = skip_blank(q);
+            auto r = from_chars(f, eol, pop);
+            if (r.ec != errc()) { reason = "bad population"; }
+            if (!reason)
+            {
+                r = from_chars(skip_blank(r.ptr), eol, lat);
+                if (r.ec != errc()) { reason = "bad latitude"; }
+            }
+            if (!reason)
+            {
+                r = from_chars(skip_blank(r.ptr), eol, lon);
+                if (r.ec != errc()) { reason = "bad longitude"; }
+            }
+            const char* rest = skip_blank(r.ptr);
+            if (!reason && rest != eol && !(rest + 1 == eol && *rest == '\r'))
+            {
+                reason = "extra characters";
+            }
+            if (!reason)
+            {
+                out.names.append(p, name_end);
+                out.name_offsets.push_back(out.names.size());
+                out.population.push_back(pop);
+                out.latitude.push_back(lat);
+                out.longitude.push_back(lon);
+                parsed++;
+                p = (eol == end) ? end : eol + 1;
+                line = name_line + 2;
+                continue;
+            }
+        }
+        errors.push_back({name_line, reason});
+        p = q;
+        line = name_line + 1;
+    }
+    return parsed;
+}
+
+/*
+ * Сравнение с istream_iterator<city> по скорости и по памяти.
+ */
+void bench_cities()
+{
+    string text;
+    unsigned seed = 7;
+    for (size_t i = 0; i < 500000; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        text += (seed >> 16) % 3 ? "Settlement number " : "Town ";
+        text += to_string(i);
+        text += '\n';
+        text += to_string(seed % 1000000) + " " + to_string((seed >> 8) % 18000 / 100.0)
+              + " " + to_string((seed >> 4) % 36000 / 100.0) + "\n";
+    }
+
+    auto t0 = chrono::steady_clock::now();
+    vector<city> vCity;
+    istringstream ss(text);
+    copy(istream_iterator<city>{ss}, {}, back_inserter(vCity));
+    auto t1 = chrono::steady_clock::now();
+    city_columns columns;
+    vector<parse_error> errors;
+    parse_cities(text, columns, errors);
+    auto t2 = chrono::steady_clock::now();
+
+    size_t stream_memory = vCity.capacity() * sizeof(city);
+    for (const auto& c : vCity)
+    {
+        if (c.name.capacity() > 15) { stream_memory += c.name.capacity() + 1; }
+    }
+    cout << "istream_iterator<city>: " << vCity.size() << " records, "
+         << chrono::duration<double, milli>(t1 - t0).count() << " ms, " << stream_memory << " bytes" << endl;
+    cout << "parse_cities:           " << columns.size() << " records, "
+         << chrono::duration<double, milli>(t2 - t1).count() << " ms, " << columns.memory() << " bytes" << endl;
+
+    bool same = vCity.size() == columns.size() && errors.empty();
+    for (size_t i = 0; same && i < vCity.size(); i++)
+    {
+        same = vCity[i].name == columns.name(i) && vCity[i].population == columns.population[i]
+            && vCity[i].latitude == columns.latitude[i] && vCity[i].longitude == columns.longitude[i];
+    }
+    if (!same) { cout << "Parsed records differ!" << endl; }
+}
+
 int main(int argc, char* argv[])
 {
+    if (argc == 2 && string(argv[1]) == "-b") {
+        if (!check_whitespace()) return 1;
+        bench_tokenizers();
+        bench_cities();
+        return 0;
+    }
+
     //1
     string test1 {" \t\n hello world \t\n "};
     string test2 {""};
@@ -187,6 +586,8 @@ int main(int argc, char* argv[])
     cout << "|" << fast_trim(string_view(c_str, sizeof(c_str))) << "|" << endl;
     
     //3
+    if (!check_whitespace()) return 1;
+    parse_buffer(" alpha, beta gamma,\tdelta,,ignored");
     parse_input_stream();
 
     //4
@@ -215,5 +616,21 @@ int main(int argc, char* argv[])
             << " lon=" << lon << endl;
     }
 
+    //6
+    // Тот же текст, разобранный parse_cities: ошибочная запись пропускается
+    city_columns columns;
+    vector<parse_error> errors;
+    parse_cities(ss.str(), columns, errors);
+    for (size_t i = 0; i < columns.size(); i++) {
+        cout << left << setw(15)
+            << columns.name(i)
+            << " population=" << columns.population[i]
+            << " lat=" << columns.latitude[i]
+            << " lon=" << columns.longitude[i] << endl;
+    }
+    for (const auto& e : errors) {
+        cout << "line " << e.line << ": " << e.reason << endl;
+    }
+
     return 0;
 }
\ No newline at end of file
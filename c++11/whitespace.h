@@ -0,0 +1,328 @@
+#ifndef TOOLKIT_WHITESPACE_H
+#define TOOLKIT_WHITESPACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+#include "simd.h"
+
+namespace Toolkit {
+
+/**
+ * @brief Character classes of the whitespace kernels.
+ */
+enum class SpaceSet {
+    eBLANK = 0, ///< " \t\n", the set used for trimming
+    eISSPACE    ///< " \t\n\v\f\r", isspace() in the "C" locale
+};
+
+namespace detail {
+
+inline bool is_space(unsigned char c, SpaceSet set) {
+    if (set == SpaceSet::eBLANK) {
+        return c == ' ' || c == '\t' || c == '\n';
+    }
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+/*
+ * Raw kernels. find_first returns the index of the first character outside
+ * the set or n, find_last the index of the last one or n. collapse keeps the
+ * first character of every run of whitespace and returns the new length.
+ * find_space returns the index of the first whitespace character or n.
+ * count_words counts the characters outside the set that follow whitespace;
+ * prev tells whether the character before s is whitespace.
+ */
+typedef size_t (*space_find_kernel)(const char* s, size_t n, SpaceSet set);
+typedef size_t (*space_collapse_kernel)(char* s, size_t n, SpaceSet set);
+typedef size_t (*space_count_kernel)(const char* s, size_t n, SpaceSet set, bool prev);
+
+inline size_t find_first_scalar(const char* s, size_t n, SpaceSet set) {
+    size_t i = 0;
+    while (i < n && is_space(s[i], set)) i++;
+    return i;
+}
+
+inline size_t find_space_scalar(const char* s, size_t n, SpaceSet set) {
+    size_t i = 0;
+    while (i < n && !is_space(s[i], set)) i++;
+    return i;
+}
+
+inline size_t count_words_scalar(const char* s, size_t n, SpaceSet set, bool prev) {
+    size_t words = 0;
+    for (size_t i = 0; i < n; i++) {
+        const bool space = is_space(s[i], set);
+        words += (!space && prev);
+        prev = space;
+    }
+    return words;
+}
+
+inline size_t find_last_scalar(const char* s, size_t n, SpaceSet set) {
+    for (size_t i = n; i-- > 0;) {
+        if (!is_space(s[i], set)) return i;
+    }
+    return n;
+}
+
+/**
+ * @brief Collapses whitespace in [s + from, s + n), writing from out on;
+ * prev tells whether s[from - 1] was whitespace.
+ */
+inline size_t collapse_tail(char* s, size_t from, size_t n, size_t out, bool prev, SpaceSet set) {
+    for (size_t i = from; i < n; i++) {
+        const bool space = is_space(s[i], set);
+        if (!(space && prev)) s[out++] = s[i];
+        prev = space;
+    }
+    return out;
+}
+
+inline size_t collapse_scalar(char* s, size_t n, SpaceSet set) {
+    return collapse_tail(s, 0, n, 0, false, set);
+}
+
+#ifdef TOOLKIT_X86
+
+__attribute__((target("sse2")))
+inline unsigned space_mask_sse2(__m128i v, SpaceSet set) {
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+    if (set == SpaceSet::eISSPACE) {
+        // '\t'..'\r'; bytes >= 0x80 are negative and fail the first compare
+        m = _mm_or_si128(m, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)),
+                                          _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1))));
+    }
+    return (unsigned)_mm_movemask_epi8(m);
+}
+
+__attribute__((target("avx2")))
+inline uint32_t space_mask_avx2(__m256i v, SpaceSet set) {
+    __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')),
+                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+    if (set == SpaceSet::eISSPACE) {
+        m = _mm256_or_si256(m, _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)),
+                                                _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v)));
+    }
+    return (uint32_t)_mm256_movemask_epi8(m);
+}
+
+__attribute__((target("sse2")))
+inline size_t find_first_sse2(const char* s, size_t n, SpaceSet set) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        unsigned m = space_mask_sse2(_mm_loadu_si128((const __m128i*)(s + i)), set);
+        if (m != 0xFFFF) return i + __builtin_ctz(~m);
+    }
+    return i + find_first_scalar(s + i, n - i, set);
+}
+
+__attribute__((target("sse2")))
+inline size_t find_space_sse2(const char* s, size_t n, SpaceSet set) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        unsigned m = space_mask_sse2(_mm_loadu_si128((const __m128i*)(s + i)), set);
+        if (m != 0) return i + __builtin_ctz(m);
+    }
+    return i + find_space_scalar(s + i, n - i, set);
+}
+
+__attribute__((target("sse2")))
+inline size_t count_words_sse2(const char* s, size_t n, SpaceSet set, bool prev) {
+    size_t words = 0, i = 0;
+    unsigned carry = prev;
+    for (; i + 16 <= n; i += 16) {
+        unsigned m = space_mask_sse2(_mm_loadu_si128((const __m128i*)(s + i)), set);
+        words += __builtin_popcount(~m & ((m << 1) | carry) & 0xFFFF);
+        carry = m >> 15;
+    }
+    return words + count_words_scalar(s + i, n - i, set, carry != 0);
+}
+
+__attribute__((target("sse2")))
+inline size_t find_last_sse2(const char* s, size_t n, SpaceSet set) {
+    size_t i = n;
+    for (; i >= 16; i -= 16) {
+        unsigned m = space_mask_sse2(_mm_loadu_si128((const __m128i*)(s + i - 16)), set);
+        if (m != 0xFFFF) return i - 16 + (31 - __builtin_clz(~m & 0xFFFF));
+    }
+    size_t last = find_last_scalar(s, i, set);
+    return (last == i) ? n : last;
+}
+
+/*
+ * A block of 16 bytes without two whitespace characters in a row is copied
+ * as a whole; blocks with a run inside go byte by byte. The store never
+ * passes the bytes already loaded, so compaction in place is safe.
+ */
+__attribute__((target("sse2")))
+inline size_t collapse_sse2(char* s, size_t n, SpaceSet set) {
+    size_t out = 0, i = 0;
+    unsigned carry = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        unsigned m = space_mask_sse2(v, set);
+        unsigned drop = m & ((m << 1) | carry);
+        if (drop == 0) {
+            _mm_storeu_si128((__m128i*)(s + out), v);
+            out += 16;
+        } else {
+            out = collapse_tail(s, i, i + 16, out, carry != 0, set);
+        }
+        carry = m >> 15;
+    }
+    return collapse_tail(s, i, n, out, carry != 0, set);
+}
+
+__attribute__((target("avx2")))
+inline size_t find_first_avx2(const char* s, size_t n, SpaceSet set) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        uint32_t m = space_mask_avx2(_mm256_loadu_si256((const __m256i*)(s + i)), set);
+        if (m != 0xFFFFFFFFu) return i + __builtin_ctz(~m);
+    }
+    return i + find_first_scalar(s + i, n - i, set);
+}
+
+__attribute__((target("avx2")))
+inline size_t find_space_avx2(const char* s, size_t n, SpaceSet set) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        uint32_t m = space_mask_avx2(_mm256_loadu_si256((const __m256i*)(s + i)), set);
+        if (m != 0) return i + __builtin_ctz(m);
+    }
+    return i + find_space_scalar(s + i, n - i, set);
+}
+
+__attribute__((target("avx2,popcnt")))
+inline size_t count_words_avx2(const char* s, size_t n, SpaceSet set, bool prev) {
+    size_t words = 0, i = 0;
+    uint32_t carry = prev;
+    for (; i + 32 <= n; i += 32) {
+        uint32_t m = space_mask_avx2(_mm256_loadu_si256((const __m256i*)(s + i)), set);
+        words += __builtin_popcount(~m & ((m << 1) | carry));
+        carry = m >> 31;
+    }
+    return words + count_words_scalar(s + i, n - i, set, carry != 0);
+}
+
+__attribute__((target("avx2")))
+inline size_t find_last_avx2(const char* s, size_t n, SpaceSet set) {
+    size_t i = n;
+    for (; i >= 32; i -= 32) {
+        uint32_t m = space_mask_avx2(_mm256_loadu_si256((const __m256i*)(s + i - 32)), set);
+        if (m != 0xFFFFFFFFu) return i - 32 + (31 - __builtin_clz(~m));
+    }
+    size_t last = find_last_scalar(s, i, set);
+    return (last == i) ? n : last;
+}
+
+__attribute__((target("avx2")))
+inline size_t collapse_avx2(char* s, size_t n, SpaceSet set) {
+    size_t out = 0, i = 0;
+    uint32_t carry = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+        uint32_t m = space_mask_avx2(v, set);
+        uint32_t drop = m & ((m << 1) | carry);
+        if (drop == 0) {
+            _mm256_storeu_si256((__m256i*)(s + out), v);
+            out += 32;
+        } else {
+            out = collapse_tail(s, i, i + 32, out, carry != 0, set);
+        }
+        carry = m >> 31;
+    }
+    return collapse_tail(s, i, n, out, carry != 0, set);
+}
+
+#endif // TOOLKIT_X86
+
+struct space_kernels {
+    space_find_kernel first;
+    space_find_kernel last;
+    space_collapse_kernel collapse;
+    space_find_kernel space;
+    space_count_kernel words;
+};
+
+inline space_kernels select_space_kernels(SimdLevel level) {
+    level = std::min(level, simd_level());
+#ifdef TOOLKIT_X86
+    if (level == SimdLevel::eAVX2) {
+        return { find_first_avx2, find_last_avx2, collapse_avx2, find_space_avx2, count_words_avx2 };
+    }
+    if (level == SimdLevel::eSSE2) {
+        return { find_first_sse2, find_last_sse2, collapse_sse2, find_space_sse2, count_words_sse2 };
+    }
+#endif
+    return { find_first_scalar, find_last_scalar, collapse_scalar, find_space_scalar, count_words_scalar };
+}
+
+inline space_kernels space_kernels_for(SimdLevel level) {
+    static const space_kernels best = select_space_kernels(SimdLevel::eAVX2);
+    return (level == SimdLevel::eAVX2) ? best : select_space_kernels(level);
+}
+
+}
+
+/**
+ * @brief Index of the first character of [s, s + n) outside the set.
+ *
+ * @param level Highest instruction set to use, capped by simd_level().
+ * @return n if all characters are whitespace
+ */
+inline size_t find_first_not_space(const char* s, size_t n, SpaceSet set = SpaceSet::eBLANK,
+                                   SimdLevel level = SimdLevel::eAVX2) {
+    return detail::space_kernels_for(level).first(s, n, set);
+}
+
+/**
+ * @brief Index of the last character of [s, s + n) outside the set.
+ *
+ * @return n if all characters are whitespace
+ */
+inline size_t find_last_not_space(const char* s, size_t n, SpaceSet set = SpaceSet::eBLANK,
+                                  SimdLevel level = SimdLevel::eAVX2) {
+    return detail::space_kernels_for(level).last(s, n, set);
+}
+
+/**
+ * @brief Index of the first whitespace character of [s, s + n).
+ *
+ * @return n if there is none
+ */
+inline size_t find_first_space(const char* s, size_t n, SpaceSet set = SpaceSet::eISSPACE,
+                               SimdLevel level = SimdLevel::eAVX2) {
+    return detail::space_kernels_for(level).space(s, n, set);
+}
+
+/**
+ * @brief Number of words in [s, s + n), words being runs of characters
+ * outside the set, as istream_iterator<string> sees them.
+ *
+ * @param prev Whether the character before s is whitespace. Pass false to
+ * continue a word from the previous part of a split buffer.
+ */
+inline size_t count_words(const char* s, size_t n, SpaceSet set = SpaceSet::eISSPACE,
+                          bool prev = true, SimdLevel level = SimdLevel::eAVX2) {
+    return detail::space_kernels_for(level).words(s, n, set, prev);
+}
+
+/**
+ * @brief Replaces every run of whitespace in [s, s + n) with its first
+ * character, in place, like std::unique_copy() with an isspace() predicate.
+ *
+ * @return New length
+ */
+inline size_t collapse_spaces(char* s, size_t n, SpaceSet set = SpaceSet::eISSPACE,
+                              SimdLevel level = SimdLevel::eAVX2) {
+    return detail::space_kernels_for(level).collapse(s, n, set);
+}
+
+}
+
+#endif
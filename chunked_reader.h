@@ -0,0 +1,450 @@
+#ifndef CHUNKED_READER_H
+#define CHUNKED_READER_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define CHUNKED_READER_URING 1
+#endif
+
+/*
+ * Reads a file in large chunks with several reads in flight and hands the
+ * chunks to a consumer in file order, so the consumer works on chunk N while
+ * the following chunks are being loaded.
+ *
+ * Two backends are available: io_uring (driven through the raw system calls,
+ * no liburing needed) and a pool of threads calling pread(). eAUTO picks
+ * io_uring and falls back to the pool when the kernel refuses it.
+ *
+ * The buffer passed to the consumer is valid only during the call.
+ * A failed read stops the file at the last complete chunk and lastError()
+ * tells why; eAUTO retries with the pool if io_uring failed before anything
+ * was delivered.
+ */
+class ChunkedReader
+{
+public:
+    enum Backend { eAUTO, eURING, eTHREADS };
+
+    // data, length and file offset of one chunk
+    typedef std::function<void(const char*, size_t, uint64_t)> Consumer;
+
+    explicit ChunkedReader(size_t chunkSize = 1 << 20, unsigned depth = 8, Backend backend = eAUTO)
+        :    chunkSize((chunkSize + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT),
+             depth(depth ? depth : 1),
+             backend(backend),
+             used(eTHREADS),
+             errorCode(0),
+             buffer(NULL)
+    {
+    }
+
+    ~ChunkedReader()
+    {
+        free(buffer);
+    }
+
+    /**
+     * @brief Reads the whole file through the consumer.
+     *
+     * @return number of bytes delivered, the file size unless a read failed
+     */
+    uint64_t read(const char *fileName, const Consumer &consumer)
+    {
+        errorCode = 0;
+        int fd = open(fileName, O_RDONLY);
+        if (fd < 0)
+        {
+            errorCode = errno;
+            return 0;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !allocate())
+        {
+            errorCode = errno ? errno : ENOMEM;
+            close(fd);
+            return 0;
+        }
+        uint64_t fileSize = st.st_size;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        uint64_t delivered = 0;
+        bool done = false;
+#ifdef CHUNKED_READER_URING
+        if (backend != eTHREADS)
+        {
+            used = eURING;
+            done = readUring(fd, fileSize, consumer, delivered);
+        }
+#endif
+        if (!done && backend != eURING)
+        {
+            errorCode = 0;
+            used = eTHREADS;
+            readThreads(fd, fileSize, consumer, delivered);
+        }
+        close(fd);
+        return delivered;
+    }
+
+    // backend that served the last read()
+    Backend lastBackend() const { return used; }
+
+    // errno of the last read(), 0 if the whole file was delivered
+    int lastError() const { return errorCode; }
+
+private:
+    ChunkedReader(const ChunkedReader&);
+    ChunkedReader &operator=(const ChunkedReader&);
+
+    static const size_t ALIGNMENT = 4096;
+
+    bool allocate()
+    {
+        if (buffer)
+            return true;
+        if (posix_memalign((void**)&buffer, ALIGNMENT, chunkSize * depth) != 0)
+        {
+            buffer = NULL;
+            return false;
+        }
+        return true;
+    }
+
+    char *slot(uint64_t chunk) const
+    {
+        return buffer + (chunk % depth) * chunkSize;
+    }
+
+    static uint64_t chunks(uint64_t fileSize, size_t chunkSize)
+    {
+        return (fileSize + chunkSize - 1) / chunkSize;
+    }
+
+#ifdef CHUNKED_READER_URING
+    /*
+     * Minimal io_uring: one submission and one completion ring mapped from
+     * the kernel, with the memory ordering liburing uses.
+     */
+    class Uring
+    {
+    public:
+        Uring() : fd(-1), sqPtr(MAP_FAILED), cqPtr(MAP_FAILED), sqes(MAP_FAILED), pending(0), inflight(0) {}
+
+        ~Uring()
+        {
+            if (sqes != MAP_FAILED)
+                munmap(sqes, sqesSize);
+            if (cqPtr != MAP_FAILED && cqPtr != sqPtr)
+                munmap(cqPtr, cqSize);
+            if (sqPtr != MAP_FAILED)
+                munmap(sqPtr, sqSize);
+            if (fd >= 0)
+                close(fd);
+        }
+
+        bool init(unsigned entries)
+        {
+            struct io_uring_params p;
+            memset(&p, 0, sizeof(p));
+            fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+            if (fd < 0)
+                return false;
+
+            sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+            bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single)
+                sqSize = cqSize = (sqSize > cqSize) ? sqSize : cqSize;
+
+            sqPtr = mmap(NULL, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            if (sqPtr == MAP_FAILED)
+                return false;
+            cqPtr = single ? sqPtr
+                           : mmap(NULL, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqPtr == MAP_FAILED)
+                return false;
+            sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+            sqes = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+            if (sqes == MAP_FAILED)
+                return false;
+
+            char *sq = static_cast<char*>(sqPtr);
+            sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+            sqMask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+            sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+            char *cq = static_cast<char*>(cqPtr);
+            cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+            cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+            cqMask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+            cqes = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+            pending = 0;
+            inflight = 0;
+            return true;
+        }
+
+        void read(int fileFd, void *buf, unsigned len, uint64_t offset, uint64_t userData)
+        {
+            unsigned tail = *sqTail;
+            unsigned idx = tail & sqMask;
+            struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe*>(sqes) + idx;
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fileFd;
+            sqe->addr = (uint64_t)(uintptr_t)buf;
+            sqe->len = len;
+            sqe->off = offset;
+            sqe->user_data = userData;
+            sqArray[idx] = idx;
+            __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+            pending++;
+        }
+
+        // submits the queued reads and waits for at least one completion
+        bool wait(struct io_uring_cqe &cqe)
+        {
+            for (;;)
+            {
+                unsigned head = *cqHead;
+                if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+                {
+                    cqe = cqes[head & cqMask];
+                    __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+                    inflight--;
+                    return true;
+                }
+                int ret = (int)syscall(__NR_io_uring_enter, fd, pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+                if (ret < 0 && errno != EINTR)
+                    return false;
+                if (ret > 0)
+                {
+                    pending -= ret;
+                    inflight += ret;
+                }
+            }
+        }
+
+        /*
+         * Waits out every read the kernel accepted, so none of them writes
+         * into the buffers after we return. Reads still queued in the
+         * submission ring were never seen by the kernel and are dropped.
+         */
+        bool drain()
+        {
+            struct io_uring_cqe cqe;
+            pending = 0;
+            while (inflight > 0)
+            {
+                if (!wait(cqe))
+                    return false;
+            }
+            return true;
+        }
+
+    private:
+        int fd;
+        void *sqPtr, *cqPtr, *sqes;
+        size_t sqSize, cqSize, sqesSize;
+        unsigned *sqTail, *sqArray, sqMask;
+        unsigned *cqHead, *cqTail, cqMask;
+        struct io_uring_cqe *cqes;
+        unsigned pending;   // queued, not yet submitted
+        unsigned inflight;  // submitted, completion not yet reaped
+    };
+
+    /*
+     * Every slot keeps one read in flight. Completions arrive in any order;
+     * the slot of the next chunk is delivered as soon as it is full and is
+     * immediately reused for the chunk depth positions ahead.
+     */
+    bool readUring(int fd, uint64_t fileSize, const Consumer &consumer, uint64_t &delivered)
+    {
+        Uring ring;
+        if (!ring.init(depth))
+        {
+            errorCode = errno;
+            return false;
+        }
+
+        const uint64_t total = chunks(fileSize, chunkSize);
+        std::vector<size_t> filled(depth, 0), wanted(depth, 0);
+        std::vector<uint64_t> owner(depth, 0);
+
+        uint64_t issued = 0;
+        for (; issued < total && issued < depth; ++issued)
+            issue(ring, fd, fileSize, issued, filled, wanted, owner);
+
+        uint64_t next = 0;
+        int error = 0;
+        while (next < total)
+        {
+            struct io_uring_cqe cqe;
+            if (!ring.wait(cqe))
+            {
+                error = errno;
+                break;
+            }
+            size_t s = (size_t)cqe.user_data;
+            if (cqe.res <= 0)
+            {
+                // read error, or the file got shorter than fstat() said
+                error = cqe.res < 0 ? -cqe.res : EIO;
+                break;
+            }
+            filled[s] += cqe.res;
+            if (filled[s] < wanted[s])
+            {
+                // short read: ask for the rest of the chunk
+                uint64_t off = owner[s] * chunkSize + filled[s];
+                ring.read(fd, slot(owner[s]) + filled[s], (unsigned)(wanted[s] - filled[s]), off, s);
+                continue;
+            }
+
+            while (next < total && owner[next % depth] == next && filled[next % depth] == wanted[next % depth])
+            {
+                size_t cur = next % depth;
+                consumer(slot(next), wanted[cur], next * chunkSize);
+                delivered += wanted[cur];
+                ++next;
+                if (issued < total)
+                    issue(ring, fd, fileSize, issued++, filled, wanted, owner);
+            }
+        }
+
+        if (!ring.drain())
+        {
+            // the kernel may still write into the slots: give them up rather
+            // than free or reuse them, the next read() allocates new ones
+            buffer = NULL;
+            if (!error)
+                error = errno;
+        }
+        errorCode = error;
+        // nothing reached the consumer, so the pool can start from scratch
+        return !error || delivered > 0;
+    }
+
+    void issue(Uring &ring, int fd, uint64_t fileSize, uint64_t chunk,
+               std::vector<size_t> &filled, std::vector<size_t> &wanted, std::vector<uint64_t> &owner)
+    {
+        size_t s = chunk % depth;
+        uint64_t off = chunk * chunkSize;
+        owner[s] = chunk;
+        filled[s] = 0;
+        wanted[s] = (size_t)((fileSize - off < chunkSize) ? fileSize - off : chunkSize);
+        ring.read(fd, slot(chunk), (unsigned)wanted[s], off, s);
+    }
+#endif
+
+    /*
+     * Workers take chunks in file order; chunk N may start only after the
+     * consumer released chunk N - depth, which used the same slot.
+     */
+    void readThreads(int fd, uint64_t fileSize, const Consumer &consumer, uint64_t &delivered)
+    {
+        const uint64_t total = chunks(fileSize, chunkSize);
+        enum State { eFREE, eREADING, eREADY, eFAILED };
+        std::vector<State> state(depth, eFREE);
+        std::vector<size_t> length(depth, 0);
+        uint64_t nextIssue = 0;
+        int error = 0;
+        bool stop = false;
+        std::mutex mutex;
+        std::condition_variable cond;
+
+        auto worker = [&]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;)
+            {
+                cond.wait(lock, [&]() { return stop || nextIssue >= total || state[nextIssue % depth] == eFREE; });
+                if (stop || nextIssue >= total)
+                    return;
+                uint64_t chunk = nextIssue++;
+                size_t s = chunk % depth;
+                state[s] = eREADING;
+                lock.unlock();
+
+                uint64_t off = chunk * chunkSize;
+                size_t want = (size_t)((fileSize - off < chunkSize) ? fileSize - off : chunkSize);
+                size_t got = 0;
+                int failure = 0;
+                while (got < want)
+                {
+                    ssize_t n = pread(fd, slot(chunk) + got, want - got, off + got);
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n <= 0)
+                    {
+                        failure = n < 0 ? errno : EIO;
+                        break;
+                    }
+                    got += n;
+                }
+
+                lock.lock();
+                if (failure && !error)
+                    error = failure;
+                length[s] = got;
+                state[s] = (got == want) ? eREADY : eFAILED;
+                cond.notify_all();
+            }
+        };
+
+        unsigned threadsCount = depth < 4 ? depth : 4;
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < threadsCount; ++i)
+            threads.push_back(std::thread(worker));
+
+        for (uint64_t chunk = 0; chunk < total; ++chunk)
+        {
+            size_t s = chunk % depth;
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&]() { return state[s] == eREADY || state[s] == eFAILED; });
+            if (state[s] == eFAILED)
+                break;
+            lock.unlock();
+
+            consumer(slot(chunk), length[s], chunk * chunkSize);
+            delivered += length[s];
+
+            lock.lock();
+            state[s] = eFREE;
+            cond.notify_all();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+            cond.notify_all();
+        }
+        for (size_t i = 0; i < threads.size(); ++i)
+            threads[i].join();
+        errorCode = error;
+    }
+
+    size_t chunkSize;
+    unsigned depth;
+    Backend backend;
+    Backend used;
+    int errorCode;
+    char *buffer;
+};
+
+#endif
@@ -14,6 +14,7 @@
 // - length
 //
 // with some kind of value
+// selftest checks the tokenizer against the old one
 
 
 class testApp : public ofBaseApp {
@@ -27,13 +28,14 @@ public:
 
 	ofxTerminal<testApp> terminal;
 	
-	std::string setFrequency(std::vector<std::string> args);
-	std::string setAmplitude(std::vector<std::string> args);
-	std::string setLength(std::vector<std::string> args);
-	std::string setSpeed(std::vector<std::string> args);
+	std::string setFrequency(ofxTerminalArgs args);
+	std::string setAmplitude(ofxTerminalArgs args);
+	std::string setLength(ofxTerminalArgs args);
+	std::string setSpeed(ofxTerminalArgs args);
 	
-	std::string blink(std::vector<std::string> args);
-	std::string setPS1(std::vector<std::string> args);
+	std::string blink(ofxTerminalArgs args);
+	std::string setPS1(ofxTerminalArgs args);
+	std::string selfTest(ofxTerminalArgs args);
 	
 	float counter, speed;
 	int length;
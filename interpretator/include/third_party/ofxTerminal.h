@@ -29,22 +29,155 @@
 
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
+#include <charconv>
+#include <memory>
+#include <unordered_map>
+#include <random>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <sys/stat.h>
 
 #define _DEF_FONT_ "font/courier-new-bold.ttf"
 #define _DEF_PATH_ "bin/"
+#define _DEF_HISTORY_ 10000 //rows kept for scrolling back
+#define _DEF_PAGE_ROWS_ 64  //rows drawn from one cached mesh
+
+//a single argument, it points into the tokens of the line being executed
+//so it is only valid while the handler runs. call str() to keep it.
+class ofxTerminalArg {
+public:
+	ofxTerminalArg(std::string_view s = std::string_view()) : sv(s), fval(0), ival(0), parsed(false) {}
+	//numbers worked out in advance, compiled scripts use this
+	ofxTerminalArg(std::string_view s, float f, int i) : sv(s), fval(f), ival(i), parsed(true) {}
+	
+	static ofxTerminalArg number(std::string_view s) {
+		ofxTerminalArg a(s);
+		return ofxTerminalArg(s, a.toFloat(), a.toInt());
+	}
+	
+	std::string_view view() const { return sv; }
+	std::string str() const { return std::string(sv); }
+	size_t size() const { return sv.size(); }
+	bool empty() const { return sv.empty(); }
+	
+	//like ofToFloat/ofToInt these return 0 if the argument isn't a number,
+	//but they parse straight from the token without a stringstream
+	float toFloat() const {
+		float v = 0;
+		if (parsed) return fval;
+		std::string_view s = skipPlus();
+		if (std::from_chars(s.data(), s.data() + s.size(), v).ec != std::errc()) return 0;
+		return v;
+	}
+	int toInt() const {
+		int v = 0;
+		if (parsed) return ival;
+		std::string_view s = skipPlus();
+		if (std::from_chars(s.data(), s.data() + s.size(), v).ec != std::errc()) return 0;
+		return v;
+	}
+	
+	bool operator==(std::string_view s) const { return sv == s; }
+	bool operator!=(std::string_view s) const { return sv != s; }
+	
+private:
+	std::string_view skipPlus() const {
+		return (sv.size() > 1 && sv[0] == '+') ? sv.substr(1) : sv;
+	}
+	std::string_view sv;
+	float fval;
+	int ival;
+	bool parsed;
+};
+
+//non-owning list of arguments passed to a handler, nothing is copied
+class ofxTerminalArgs {
+public:
+	ofxTerminalArgs(const ofxTerminalArg *d = NULL, size_t n = 0) : ptr(d), count(n) {}
+	
+	const ofxTerminalArg& operator[](size_t i) const { return ptr[i]; }
+	const ofxTerminalArg* begin() const { return ptr; }
+	const ofxTerminalArg* end() const { return ptr + count; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	
+private:
+	const ofxTerminalArg *ptr;
+	size_t count;
+};
+
+//FNV-1a, the hash of a command name is worked out once when it is added
+inline unsigned int ofxTerminalHash(std::string_view s) {
+	unsigned int h = 2166136261u;
+	for (size_t i = 0; i < s.size(); i++) {
+		h = (h ^ (unsigned char) s[i]) * 16777619u;
+	}
+	return h;
+}
 
 template <class T>
 class Function {
 public:
-	Function<T>(std::string n, std::string(T::*f)(std::vector<std::string> args)) { 
+	Function<T>(std::string n, std::string(T::*f)(ofxTerminalArgs args)) { 
 		name = n; 
+		hash = ofxTerminalHash(name);
 		func = f; 
+		legacy = NULL;
+	};
+	//old style handler, the arguments are copied into a vector for it
+	Function<T>(std::string n, std::string(T::*f)(std::vector<std::string> args)) { 
+		name = n; 
+		hash = ofxTerminalHash(name);
+		func = NULL; 
+		legacy = f;
 	};
 	
 	std::string name;
-	std::string(T::*func)(std::vector<std::string> args);
+	unsigned int hash;
+	std::string(T::*func)(ofxTerminalArgs args);
+	std::string(T::*legacy)(std::vector<std::string> args);
+};
+
+/* - - - SCRIPTS - - - 
+ 
+ read compiles a script once and keeps it until the file changes.
+ on top of plain commands scripts understand:
+ 
+ - set name value      : a variable, used as $name in later arguments
+ - repeat n ... end    : run the lines in between n times, loops can be nested
+ 
+ - - - - - - - - - - - */
+
+struct ofxTerminalOp {
+	enum Code { eCALL, eREAD, eSET, eREPEAT, eEND };
+	Code code;
+	int index;      //function for eCALL, variable for eSET
+	int jump;       //eREPEAT: past the matching end, eEND: first line of the loop
+	size_t first, count; //arguments in ofxTerminalScript::args
+	bool hasVars;   //some argument is a $name, substituted when it runs
+};
+
+struct ofxTerminalScript {
+	std::vector<ofxTerminalOp> code;
+	std::vector<ofxTerminalArg> args; //literals have their numbers already parsed
+	std::vector<int> argVars;         //variable of each argument, -1 for literals
+	std::string text;                 //all the tokens, args point in here
+	//a rewrite in the same second with the same length still changes the
+	//nanoseconds, the inode or the status change time
+	struct timespec mtime, ctime;
+	ino_t inode;
+	off_t fileSize;
+	size_t nFunctions;                //commands added later mean a recompile
+};
+
+struct ofxTerminalVar {
+	std::string text;
+	float fval;
+	int ival;
 };
 
 //this holds all the prompt data...
@@ -76,19 +209,57 @@ private:
 	float characterOffset, spaceOffset;
 	bool autocompleteflag;
 	
-	std::vector<std::string> lines, results;
-	std::vector<std::string> dictionary;
+	//results[i] == "" means row i shows a command from lines.
+	//rows off the front of the history are forgotten, row r is still drawn at
+	//lineHeight*(r+1) counting the forgotten ones, so nothing moves on screen
+	std::deque<std::string> lines, results;
+	std::deque<int> rowLine; //line number (counting forgotten lines) of each row, -1 for results
+	int rowsDropped, linesDropped;
+	size_t historyLimit;
+	void addRow(const std::string &result);
+	
+	//everything but the prompt line is drawn from meshes, one per page of rows,
+	//built again only when a row is added to the page
+	typedef struct {
+		int first, end; //rows in the mesh
+		ofVboMesh commands, comments;
+		bool used;
+	} Page;
+	std::vector<Page> pages;
+	void drawPage(int index, int current);
+	std::vector<std::string> dictionary; //sorted up to dictionarySorted, new words go on the end
+	size_t dictionarySorted;
+	size_t completionLimit;
+	void sortDictionary();
 	
 	std::vector< Function<T> > functions;
+	std::vector<int> dispatch; //open addressing table of indices into functions, -1 is empty
+	std::vector<ofxTerminalArg> argv;
 	
 	std::string PATH; //this is where read finds files when the path doesn't begin with a '/'
-	bool readFile(std::string path);
+	std::string lastError;
+	bool readFile(const std::string &path, int depth=0);
+	
+	std::unordered_map< std::string, std::shared_ptr<const ofxTerminalScript> > scripts;
+	std::deque<ofxTerminalVar> variables; //a deque, tokens point at the text while new ones are made
+	std::unordered_map<std::string, int> variableIndex;
+	std::shared_ptr<const ofxTerminalScript> compile(const std::string &path);
+	bool run(const ofxTerminalScript &script, int depth);
+	ofxTerminalArgs scriptArgs(const ofxTerminalScript &script, const ofxTerminalOp &op);
+	int findVariable(std::string_view name, bool create);
+	int variableArg(std::string_view token);
+	void setVariable(int index, const ofxTerminalArg &value);
 
 	int stringWidth(std::string s);
 	
 	void process(std::string command);
-	void explode(std::string command, char sep, std::vector<std::string> &tokens);
-	std::string execute(std::string command);
+	std::string scratch; //escaped tokens are written here, see explode()
+	std::vector<std::string_view> tokens;
+	void explode(std::string_view command, char sep, std::vector<std::string_view> &tokens);
+	void explodeLegacy(std::string command, char sep, std::vector<std::string> &tokens);
+	std::string execute(const std::string &command);
+	int findFunction(std::string_view name) const;
+	void addToDispatch(int index);
 	
 	void println(std::string line);
 	void incrementPrompt();
@@ -103,8 +274,11 @@ public:
 	void draw(int xOffset=0, int yOffset=-2);
 	void keyPressed(int key);
 	
+	void addFunction(std::string name, std::string(T::*func)(ofxTerminalArgs args));
 	void addFunction(std::string name, std::string(T::*func)(std::vector<std::string> args));
 	void addToDictionary(std::string word);
+	size_t complete(std::string_view prefix, std::string &common, std::vector<std::string_view> &candidates, size_t k);
+	void setCompletionLimit(size_t k);
 	
 	void setPS1(std::string s);
 	void setPath(std::string s);
@@ -113,6 +287,9 @@ public:
 	void setBlinkingCursor(bool b, float freq=0.5);
 	void setFontColor(int r, int g, int b);
 	void setPromptColor(int r, int g, int b);
+	void setHistoryLimit(size_t rows);
+	
+	std::string checkTokenizer(int iterations=100000);
 };
 
 
@@ -124,6 +301,9 @@ template <class T>
 ofxTerminal<T>::ofxTerminal(T *co, std::string fontpath, int fontsize) {
 	
 	callingObj = co;
+	historyLimit = _DEF_HISTORY_;
+	dictionarySorted = 0;
+	completionLimit = 50;
 	
 	setup();
 	
@@ -143,20 +323,23 @@ ofxTerminal<T>::ofxTerminal(T *co, std::string fontpath, int fontsize) {
 
 //empty default constructor, for when ofxTerminal is located on the stack
 //this should never be explicitly called.
-template <class T> ofxTerminal<T>::ofxTerminal() {}
+template <class T> ofxTerminal<T>::ofxTerminal() : historyLimit(_DEF_HISTORY_), dictionarySorted(0), completionLimit(50) {}
 
 template <class T>
 void ofxTerminal<T>::setup() {
 
 	lines.clear();
 	results.clear();
+	rowLine.clear();
+	pages.clear();
+	rowsDropped = linesDropped = 0;
 	cl = 0;
 	prompt.yOffset = 2;
 	prompt.x = -5;
 	prompt.y = prompt.yOffset;
 	prompt.index = 0;
 	lines.push_back("");
-	results.push_back("");
+	addRow("");
 	screenYPos = 0;
 	prevCommand = 0;
 	PATH = _DEF_PATH_; //hardcode your own path here...
@@ -190,18 +373,29 @@ void ofxTerminal<T>::draw(int xOffset, int yOffset) {
 	
 	//this is where we draw all commands previous and present.
 	//not future... yet
-	int j = 0;
-	for (int i = 0; i < results.size(); i++) {
-		if (results[i] == "") {
-			ofSetColor(fontcolor[0], fontcolor[1], fontcolor[2]);
-			font.drawString(prompt.PS1 + lines[j++], 0, lineHeight*(i+1));
-		} 
-		//draw results/comments
-		else {
-			ofSetColor(fontcolor[0]*8, fontcolor[1]*8, fontcolor[2]*8);
-			font.drawString(results[i], 0, lineHeight*(i+1));
-		}		
-	}	
+	//only the rows on screen, plus one either side for the descenders
+	int top = -(screenYPos + yOffset);
+	int height = std::max(lineHeight, 1); //no font, no rows
+	int current = rowsDropped + results.size() - 1; //the row being typed
+	int firstRow = std::max(rowsDropped, top / height - 1);
+	int lastRow = std::min(current, (top + ofGetHeight()) / height + 1);
+	
+	for (size_t i = 0; i < pages.size(); i++) {
+		pages[i].used = false;
+	}
+	for (int p = firstRow / _DEF_PAGE_ROWS_; p <= lastRow / _DEF_PAGE_ROWS_; p++) {
+		drawPage(p, current);
+	}
+	//forget the pages that scrolled away
+	for (size_t i = 0; i < pages.size(); ) {
+		if (pages[i].used) i++;
+		else pages.erase(pages.begin() + i);
+	}
+	
+	if (firstRow <= current && lastRow == current) {
+		ofSetColor(fontcolor[0], fontcolor[1], fontcolor[2]);
+		font.drawString(prompt.PS1 + lines[cl], 0, lineHeight*(current+1));
+	}
 	
 	//this is where we draw the prompt
 	ofSetColor(prompt.color[0], prompt.color[1], prompt.color[2], blinker ? 100 : 0); //make the prompt a transparent grey
@@ -220,6 +414,51 @@ void ofxTerminal<T>::draw(int xOffset, int yOffset) {
 }
 
 
+//draws the rows of page index that are finished, ie everything before current
+template <class T>
+void ofxTerminal<T>::drawPage(int index, int current) {
+	int first = std::max(index * _DEF_PAGE_ROWS_, rowsDropped);
+	int end = std::min((index + 1) * _DEF_PAGE_ROWS_, current);
+	if (end <= first) return;
+	
+	Page *page = NULL;
+	for (size_t i = 0; i < pages.size(); i++) {
+		if (pages[i].first / _DEF_PAGE_ROWS_ == index) page = &pages[i];
+	}
+	if (!page) {
+		pages.push_back(Page());
+		page = &pages.back();
+		page->first = page->end = -1;
+	}
+	page->used = true;
+	
+	//rebuild when a row was added to the page or fell off the history
+	if (page->first != first || page->end != end) {
+		page->first = first;
+		page->end = end;
+		page->commands.clear();
+		page->comments.clear();
+		for (int r = first; r < end; r++) {
+			int i = r - rowsDropped;
+			if (rowLine[i] >= 0) {
+				page->commands.append(font.getStringMesh(prompt.PS1 + lines[rowLine[i] - linesDropped], 0, lineHeight*(r+1), ofIsVFlipped()));
+			}
+			else {
+				page->comments.append(font.getStringMesh(results[i], 0, lineHeight*(r+1), ofIsVFlipped()));
+			}
+		}
+	}
+	
+	font.getFontTexture().bind();
+	ofSetColor(fontcolor[0], fontcolor[1], fontcolor[2]);
+	page->commands.draw();
+	//draw results/comments
+	ofSetColor(fontcolor[0]*8, fontcolor[1]*8, fontcolor[2]*8);
+	page->comments.draw();
+	font.getFontTexture().unbind();
+}
+
+
 /* - - - KEY ACTIONS - - - - - - - - - 
  
  this is where all the key presses are interpreted
@@ -322,31 +561,19 @@ void ofxTerminal<T>::keyPressed(int key) {
 			if (lastspace < 1) lastspace = 0;
 			todo = todo.substr(lastspace);
 			
-			std::vector<std::string> foundwords;
+			std::string common;
+			std::vector<std::string_view> foundwords;
+			size_t found = complete(todo, common, foundwords, completionLimit);
 			
-			//before any uber computer scientist has a go at me, 
-			//i don't think we are going to have a large dictionary so
-			//i think a linear search is good enough...
-			for (int i = 0; i < dictionary.size(); i++) {
-				bool show = true;
-				for (int j = 0; j < todo.length() && j < dictionary[i].length(); j++) {
-					if (dictionary[i].at(j) != todo.at(j)) {
-						show = false;
-						break;
-					}
-				}
-				if (show) {
-					foundwords.push_back(dictionary[i]);
-				}
-			}
-			
-			//if there is only one possibility then change the current line
-			if (foundwords.size() == 1) {
+			//if there is only one possibility, or all of them start with more
+			//than we have typed, change the current line
+			if (found == 1 || common.length() > todo.length()) {
 				//change the command
-				std::string t = lines[cl].substr(0, lastspace) + foundwords[0];
+				std::string t = lines[cl].substr(0, lastspace) + common;
 				
 				//only add a space at the end if we are at the end of the line
-				if (lines[cl].length() == prompt.index) {
+				//and the word is finished
+				if (found == 1 && lines[cl].length() == prompt.index) {
 					t+= " ";
 				}
 				
@@ -355,11 +582,12 @@ void ofxTerminal<T>::keyPressed(int key) {
 
 				prompt.x = stringWidth(t);//move the prompt
 				prompt.index = t.length();
+				autocompleteflag = false;
 			}
 			
 			//if we have multiple possible commands print them out in a list
 			//and then restore the prompt.
-			else if (foundwords.size() > 1) {
+			else if (found > 1) {
 				if (!autocompleteflag) {
 					autocompleteflag = true;
 					return;
@@ -368,6 +596,9 @@ void ofxTerminal<T>::keyPressed(int key) {
 				for (int i = 0; i < foundwords.size(); i++) {
 					ss << foundwords[i] << " ";
 				}
+				if (found > foundwords.size()) {
+					ss << "... " << found - foundwords.size() << " more";
+				}
 				
 				//save the current line
 				std::string templine = lines[cl];
@@ -490,10 +721,9 @@ void ofxTerminal<T>::process(std::string command) {
 
 //this is done this way so we can optionally use the returned comment...
 template <class T>
-std::string ofxTerminal<T>::execute(std::string command) {
+std::string ofxTerminal<T>::execute(const std::string &command) {
 	
-	//split the line up into tokens
-	std::vector<std::string> tokens;
+	//split the line up into tokens, they point into command or scratch
 	explode(command, ' ', tokens);
 	
 	//if we have an empty line return nothing.. ie empty line
@@ -502,32 +732,92 @@ std::string ofxTerminal<T>::execute(std::string command) {
 		return "";
 	}
 	
+	//fill in the variables like scripts do, all but the name set assigns to
+	for (size_t i = (tokens[0] == "set") ? 2 : 1; i < tokens.size(); i++) {
+		int v = variableArg(tokens[i]);
+		if (v >= 0) tokens[i] = variables[v].text;
+	}
+	
 	//the one built in function we have is read.
 	//this executes the contents of a specified file.
-	else if (tokens[0] == "read" ) {
+	if (tokens[0] == "read" ) {
 		if (tokens.size() != 2) {
 			return "usage: read filename";
 		}
-		if (readFile(tokens[1])) {
+		//reading the file uses scratch too, so keep a copy of the name
+		std::string path(tokens[1]);
+		if (readFile(path)) {
 			return "";	
 		}
 		else {
-			return tokens[1] + ": can't read file";
+			return path + ": " + lastError;
+		}
+	}
+	
+	//variables, the same as in scripts
+	else if (tokens[0] == "set") {
+		if (tokens.size() != 3) {
+			return "usage: set name value";
 		}
+		setVariable(findVariable(tokens[1], true), ofxTerminalArg(tokens[2]));
+		return "";
 	}
 	
-	//now try and find a valid command...
-	//... obviously there are much faster ways of doing this but
-	//i don't think a user will have many functions, so i think it's ok
-	for (int i = 0; i < functions.size(); i++) {
-		if (tokens[0] == functions[i].name) {
-			tokens.erase(tokens.begin());
-			return ((callingObj)->*(functions[i].func))(tokens);
+	//now try and find a valid command in the hash table...
+	int index = findFunction(tokens[0]);
+	if (index >= 0) {
+		const Function<T> &f = functions[index];
+		if (f.legacy) {
+			return ((callingObj)->*(f.legacy))(std::vector<std::string>(tokens.begin() + 1, tokens.end()));
+		}
+		//the handler gets views of the tokens, argv is reused between calls
+		argv.clear();
+		for (size_t i = 1; i < tokens.size(); i++) {
+			argv.push_back(ofxTerminalArg(tokens[i]));
 		}
+		return ((callingObj)->*(f.func))(ofxTerminalArgs(argv.data(), argv.size()));
 	}
 
 	//if we get to this point, we haven't found the command...
-	return tokens[0] + ": command not found";
+	return std::string(tokens[0]) + ": command not found";
+}
+
+//returns the index of the command in functions or -1.
+//if two commands have the same name the first one wins, like the old linear search
+template <class T>
+int ofxTerminal<T>::findFunction(std::string_view name) const {
+	if (dispatch.empty()) return -1;
+	
+	unsigned int h = ofxTerminalHash(name);
+	size_t mask = dispatch.size() - 1;
+	for (size_t i = h & mask; dispatch[i] != -1; i = (i + 1) & mask) {
+		const Function<T> &f = functions[dispatch[i]];
+		if (f.hash == h && f.name == name) {
+			return dispatch[i];
+		}
+	}
+	return -1;
+}
+
+//keeps the table at most half full, so probes stay short
+template <class T>
+void ofxTerminal<T>::addToDispatch(int index) {
+	int first = index;
+	if (functions.size() * 2 > dispatch.size()) {
+		size_t n = 16;
+		while (n < functions.size() * 2) n*= 2;
+		dispatch.assign(n, -1);
+		first = 0;
+	}
+	
+	size_t mask = dispatch.size() - 1;
+	for (int j = first; j <= index; j++) {
+		size_t i = functions[j].hash & mask;
+		while (dispatch[i] != -1 && functions[dispatch[i]].name != functions[j].name) {
+			i = (i + 1) & mask;
+		}
+		if (dispatch[i] == -1) dispatch[i] = j;
+	}
 }
 
 /* - - - PROMPT STUFF - - - */
@@ -538,7 +828,7 @@ template <class T>
 void ofxTerminal<T>::println(std::string line) {
 	//show the comment if there is one and increment prompt.y
 	if (line != "") {
-		results.push_back(line);
+		addRow(line);
 		//need an extra lineHeight added to prompt.y
 		prompt.y+= lineHeight;
 		
@@ -551,7 +841,7 @@ template <class T>
 void ofxTerminal<T>::incrementPrompt() {
 	//prepare for next line...
 	lines.push_back("");
-	results.push_back("");
+	addRow("");
 	
 	//now do the housework
 	cl++;
@@ -562,6 +852,27 @@ void ofxTerminal<T>::incrementPrompt() {
 }
 
 
+//adds a row to the history and forgets the oldest rows past historyLimit.
+//the row being typed is never forgotten
+template <class T>
+void ofxTerminal<T>::addRow(const std::string &result) {
+	results.push_back(result);
+	rowLine.push_back(result == "" ? linesDropped + (int) lines.size() - 1 : -1);
+	
+	while (results.size() > historyLimit && results.size() > 1) {
+		if (rowLine.front() >= 0) {
+			lines.pop_front();
+			linesDropped++;
+			cl--;
+			if (prevCommand > cl) prevCommand = cl;
+		}
+		results.pop_front();
+		rowLine.pop_front();
+		rowsDropped++;
+	}
+}
+
+
 /* - - - ADDING STUFF - - - */
 
 template <class T>
@@ -569,9 +880,60 @@ void ofxTerminal<T>::addToDictionary(std::string word) {
 	dictionary.push_back(word);
 }
 
+//sorts the words added since the last lookup and merges them in,
+//so adding a lot of words one by one doesn't move the whole array each time
+template <class T>
+void ofxTerminal<T>::sortDictionary() {
+	if (dictionarySorted == dictionary.size()) return;
+	
+	std::sort(dictionary.begin() + dictionarySorted, dictionary.end());
+	std::inplace_merge(dictionary.begin(), dictionary.begin() + dictionarySorted, dictionary.end());
+	dictionary.erase(std::unique(dictionary.begin(), dictionary.end()), dictionary.end());
+	dictionarySorted = dictionary.size();
+}
+
+//finds the words starting with prefix with two binary searches.
+//returns how many there are, common gets the longest start they all share
+//and candidates the first k of them in alphabetical order. the candidates
+//point into the dictionary, so they go bad when a word is added.
+template <class T>
+size_t ofxTerminal<T>::complete(std::string_view prefix, std::string &common, std::vector<std::string_view> &candidates, size_t k) {
+	sortDictionary();
+	common.clear();
+	candidates.clear();
+	
+	std::vector<std::string>::const_iterator first = std::lower_bound(dictionary.begin(), dictionary.end(), prefix,
+		[](const std::string &word, std::string_view p) { return std::string_view(word) < p; });
+	std::vector<std::string>::const_iterator last = std::partition_point(first, dictionary.cend(),
+		[prefix](const std::string &word) { return std::string_view(word).substr(0, prefix.size()) == prefix; });
+	
+	size_t found = last - first;
+	if (!found) return 0;
+	
+	//in sorted order the first and the last word differ the soonest
+	const std::string &a = *first;
+	const std::string &b = *(last - 1);
+	size_t n = 0;
+	while (n < a.length() && n < b.length() && a[n] == b[n]) n++;
+	common.assign(a, 0, n);
+	
+	for (std::vector<std::string>::const_iterator it = first; it != last && candidates.size() < k; ++it) {
+		candidates.push_back(*it);
+	}
+	return found;
+}
+
+template <class T>
+void ofxTerminal<T>::addFunction(std::string name, std::string (T::*func)(ofxTerminalArgs args)) {
+	functions.push_back(Function<T>(name, func));
+	addToDispatch(functions.size() - 1);
+	addToDictionary(name);
+}
+
 template <class T>
 void ofxTerminal<T>::addFunction(std::string name, std::string (T::*func)(std::vector<std::string> args)) {
 	functions.push_back(Function<T>(name, func));
+	addToDispatch(functions.size() - 1);
 	addToDictionary(name);
 }
 
@@ -584,7 +946,73 @@ void ofxTerminal<T>::addFunction(std::string name, std::string (T::*func)(std::v
 //if you want to use a ' you have to escape it like \'
 
 template <class T>
-void ofxTerminal<T>::explode(std::string command, char sep, std::vector<std::string> &tokens) {
+void ofxTerminal<T>::explode(std::string_view command, char sep, std::vector<std::string_view> &tokens) {
+	tokens.clear();
+	bool inquotes = false;
+	bool escape = false;
+	
+	//a token is a view of command until a quote or a backslash is dropped
+	//from the middle of it, then it's copied into scratch. all the tokens
+	//together are never longer than command, so scratch doesn't move while
+	//we are writing and the views stay good until the next explode.
+	if (scratch.size() < command.size()) {
+		scratch.resize(command.size());
+	}
+	char *arena = &scratch[0];
+	size_t used = 0;
+	
+	const char *t = NULL;
+	size_t len = 0;
+	bool copied = false;
+	
+	for (size_t i = 0; i < command.length(); i++) {
+		if (command[i] == '\\') {
+			escape = true;
+			continue;
+		}
+		if (command[i] != sep || inquotes) {
+			if (command[i] == '\'' && !escape) {
+				inquotes = !inquotes;
+			}
+			else if (len == 0) {
+				t = command.data() + i;
+				len = 1;
+				copied = false;
+			}
+			else if (!copied && t + len == command.data() + i) {
+				len++;
+			}
+			else {
+				if (!copied) {
+					memcpy(arena + used, t, len);
+					t = arena + used;
+					copied = true;
+				}
+				arena[used + len++] = command[i];
+			}
+		}
+		else if (!inquotes) {
+			//same rules as explodeLegacy: a token starting with a space isn't
+			//added and carries on into the next word
+			if (len && t[0] != ' ') {
+				tokens.push_back(std::string_view(t, len));
+				if (copied) used+= len;
+				len = 0;
+			}
+		}
+		escape = false;
+	}
+	
+	// add the final one...
+	// but don't add it if it's a space... or nothing
+	if (len && !(len == 1 && t[0] == ' ')) {
+		tokens.push_back(std::string_view(t, len));
+	}
+}
+
+//the original explode, kept so checkTokenizer has something to compare with
+template <class T>
+void ofxTerminal<T>::explodeLegacy(std::string command, char sep, std::vector<std::string> &tokens) {
 	tokens.clear();
 	bool inquotes = false;
 	bool escape = false;
@@ -624,40 +1052,277 @@ void ofxTerminal<T>::explode(std::string command, char sep, std::vector<std::str
 /* - - - FILE HANDLING - - - */
 
 //returns true if file could be read and executed, false otherwise
+//and then lastError says why
 template <class T>
-bool ofxTerminal<T>::readFile(std::string path) {
-	
-	//set up stream
-	std::ifstream file;
+bool ofxTerminal<T>::readFile(const std::string &path, int depth) {
 	
-	if (path.at(0) == '/') {
-		file.open(path.c_str());
+	//a script that reads itself would never stop
+	if (depth > 16) {
+		lastError = "scripts nested too deep";
+		return false;
 	}
 	
 	//if the path is not absolute look in specified directory
-	else {
-		std::string p = PATH + path;
-		file.open(p.c_str());
+	std::string p = (!path.empty() && path.at(0) == '/') ? path : PATH + path;
+	
+	std::shared_ptr<const ofxTerminalScript> script = compile(p);
+	if (!script) {
+		return false;
+	}
+	
+	return run(*script, depth);
+}
+
+//gives back the cached script if the file hasn't changed since it was compiled
+template <class T>
+std::shared_ptr<const ofxTerminalScript> ofxTerminal<T>::compile(const std::string &path) {
+	
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		lastError = "can't read file";
+		return NULL;
 	}
 	
-	//check to see something is open
-	if (file.is_open()) {
+	typename std::unordered_map< std::string, std::shared_ptr<const ofxTerminalScript> >::iterator cached = scripts.find(path);
+	if (cached != scripts.end()) {
+		const ofxTerminalScript &c = *cached->second;
+		if (c.mtime.tv_sec == st.st_mtim.tv_sec && c.mtime.tv_nsec == st.st_mtim.tv_nsec &&
+			c.ctime.tv_sec == st.st_ctim.tv_sec && c.ctime.tv_nsec == st.st_ctim.tv_nsec &&
+			c.inode == st.st_ino && c.fileSize == st.st_size && c.nFunctions == functions.size()) {
+			return cached->second;
+		}
+	}
+	
+	std::ifstream file(path.c_str());
+	if (!file.is_open()) {
+		lastError = "can't read file";
+		return NULL;
+	}
+	
+	std::shared_ptr<ofxTerminalScript> script(new ofxTerminalScript());
+	script->mtime = st.st_mtim;
+	script->ctime = st.st_ctim;
+	script->inode = st.st_ino;
+	script->fileSize = st.st_size;
+	script->nFunctions = functions.size();
+	
+	//the tokens go into text first and the views are made at the end,
+	//text moves around while it grows
+	std::vector< std::pair<size_t, size_t> > spans;
+	std::vector<bool> numbers;
+	std::vector<int> loops;
+	std::vector<std::string_view> tokens;
+	std::string line;
+	int lineNumber = 0;
+	
+	while (file.good()) {
+		getline(file, line);
+		lineNumber++;
+		explode(line, ' ', tokens);
+		if (!tokens.size()) continue;
 		
-		while (file.good()) {
-			std::string line;
-			getline(file, line);
-			
-			//we execute here instead of process so we don't blank lines printed
-			execute(line);
+		ofxTerminalOp op;
+		op.index = -1;
+		op.jump = -1;
+		op.first = spans.size();
+		op.count = tokens.size() - 1;
+		op.hasVars = false;
+		
+		std::string error;
+		if (tokens[0] == "repeat") {
+			op.code = ofxTerminalOp::eREPEAT;
+			if (op.count != 1) error = "usage: repeat n";
+			loops.push_back(script->code.size());
+		}
+		else if (tokens[0] == "end") {
+			op.code = ofxTerminalOp::eEND;
+			if (op.count != 0 || loops.empty()) {
+				error = "end without repeat";
+			}
+			else {
+				op.jump = loops.back() + 1;
+				script->code[loops.back()].jump = script->code.size() + 1;
+				loops.pop_back();
+			}
+		}
+		else if (tokens[0] == "set") {
+			op.code = ofxTerminalOp::eSET;
+			if (op.count != 2) {
+				error = "usage: set name value";
+			}
+			else {
+				op.index = findVariable(tokens[1], true);
+				tokens.erase(tokens.begin() + 1);
+				op.count = 1;
+			}
+		}
+		else if (tokens[0] == "read") {
+			op.code = ofxTerminalOp::eREAD;
+			if (op.count != 1) error = "usage: read filename";
+		}
+		else {
+			//unknown commands did nothing in scripts before either
+			op.code = ofxTerminalOp::eCALL;
+			op.index = findFunction(tokens[0]);
+			if (op.index < 0) continue;
 		}
 		
-		//and close...
-		file.close();
+		if (error != "") {
+			lastError = "line " + std::to_string(lineNumber) + ": " + error;
+			return NULL;
+		}
 		
-		return true;
+		for (size_t i = 1; i < tokens.size(); i++) {
+			int var = variableArg(tokens[i]);
+			if (var >= 0) op.hasVars = true;
+			spans.push_back(std::make_pair(script->text.size(), tokens[i].size()));
+			script->argVars.push_back(var);
+			script->text+= tokens[i];
+		}
+		script->code.push_back(op);
 	}
 	
-	return false;
+	if (!loops.empty()) {
+		lastError = "repeat without end";
+		return NULL;
+	}
+	
+	for (size_t i = 0; i < spans.size(); i++) {
+		script->args.push_back(ofxTerminalArg::number(std::string_view(script->text).substr(spans[i].first, spans[i].second)));
+	}
+	
+	scripts[path] = script;
+	return script;
+}
+
+//the arguments of one instruction, literals are used as they are,
+//otherwise they are copied into argv with the variables filled in
+template <class T>
+ofxTerminalArgs ofxTerminal<T>::scriptArgs(const ofxTerminalScript &script, const ofxTerminalOp &op) {
+	if (!op.hasVars) {
+		return ofxTerminalArgs(script.args.data() + op.first, op.count);
+	}
+	
+	argv.clear();
+	for (size_t i = op.first; i < op.first + op.count; i++) {
+		int var = script.argVars[i];
+		if (var < 0) {
+			argv.push_back(script.args[i]);
+		}
+		else {
+			const ofxTerminalVar &v = variables[var];
+			argv.push_back(ofxTerminalArg(v.text, v.fval, v.ival));
+		}
+	}
+	return ofxTerminalArgs(argv.data(), argv.size());
+}
+
+//stops at the first read that fails, lastError names the file
+template <class T>
+bool ofxTerminal<T>::run(const ofxTerminalScript &script, int depth) {
+	
+	//loops still to go for every repeat we are in
+	std::vector<int> loops;
+	
+	size_t pc = 0;
+	while (pc < script.code.size()) {
+		const ofxTerminalOp &op = script.code[pc];
+		ofxTerminalArgs args = scriptArgs(script, op);
+		
+		switch (op.code) {
+			case ofxTerminalOp::eCALL:
+			{
+				const Function<T> &f = functions[op.index];
+				if (f.legacy) {
+					std::vector<std::string> tokens;
+					for (size_t i = 0; i < args.size(); i++) {
+						tokens.push_back(args[i].str());
+					}
+					((callingObj)->*(f.legacy))(tokens);
+				}
+				else {
+					((callingObj)->*(f.func))(args);
+				}
+				pc++;
+			}
+			break;
+				
+			case ofxTerminalOp::eREAD:
+			{
+				std::string path = args[0].str();
+				if (!readFile(path, depth + 1)) {
+					lastError = path + ": " + lastError;
+					return false;
+				}
+				pc++;
+			}
+			break;
+				
+			case ofxTerminalOp::eSET:
+				setVariable(op.index, args[0]);
+				pc++;
+				break;
+				
+			case ofxTerminalOp::eREPEAT:
+				if (args[0].toInt() > 0) {
+					loops.push_back(args[0].toInt());
+					pc++;
+				}
+				else {
+					pc = op.jump;
+				}
+				break;
+				
+			case ofxTerminalOp::eEND:
+				if (--loops.back() > 0) {
+					pc = op.jump;
+				}
+				else {
+					loops.pop_back();
+					pc++;
+				}
+				break;
+		}
+	}
+	return true;
+}
+
+template <class T>
+int ofxTerminal<T>::findVariable(std::string_view name, bool create) {
+	std::unordered_map<std::string, int>::iterator it = variableIndex.find(std::string(name));
+	if (it != variableIndex.end()) {
+		return it->second;
+	}
+	if (!create) {
+		return -1;
+	}
+	
+	//a variable used before it is set is an empty string
+	ofxTerminalVar v;
+	v.fval = 0;
+	v.ival = 0;
+	variables.push_back(v);
+	variableIndex[std::string(name)] = variables.size() - 1;
+	return variables.size() - 1;
+}
+
+//the variable a $name argument stands for, or -1 for a plain argument.
+//scripts and the prompt both go through here, so a name that was never
+//set is an empty string in both
+template <class T>
+int ofxTerminal<T>::variableArg(std::string_view token) {
+	if (token.size() > 1 && token[0] == '$') {
+		return findVariable(token.substr(1), true);
+	}
+	return -1;
+}
+
+template <class T>
+void ofxTerminal<T>::setVariable(int index, const ofxTerminalArg &value) {
+	ofxTerminalVar &v = variables[index];
+	v.fval = value.toFloat();
+	v.ival = value.toInt();
+	v.text.assign(value.view().data(), value.size());
 }
 
 /* - - - USER SETTINGS/SETTERS - - - */
@@ -665,6 +1330,20 @@ bool ofxTerminal<T>::readFile(std::string path) {
 template <class T>
 void ofxTerminal<T>::setPS1(std::string s) {	
 	prompt.PS1 = s;
+	//old commands are drawn with the new prompt too
+	pages.clear();
+}
+
+//how many rows are kept, the oldest go when the next row is added
+template <class T>
+void ofxTerminal<T>::setHistoryLimit(size_t rows) {	
+	historyLimit = std::max(rows, (size_t) 1);
+}
+
+//how many words tab prints when there is more than one
+template <class T>
+void ofxTerminal<T>::setCompletionLimit(size_t k) {	
+	completionLimit = k;
 }
 
 template <class T>
@@ -703,4 +1382,37 @@ void ofxTerminal<T>::setPromptColor(int r, int g, int b) {
 	prompt.color[0] = r;
 	prompt.color[1] = g;
 	prompt.color[2] = b;
-}
\ No newline at end of file
+}
+
+/* - - - SELF TEST - - - */
+
+//runs random lines made of the characters explode cares about through
+//explode and explodeLegacy, returns the first line where they differ
+template <class T>
+std::string ofxTerminal<T>::checkTokenizer(int iterations) {
+	const char alphabet[] = { 'a', 'b', ' ', ' ', '\'', '\\', '$' };
+	std::mt19937 rng(12345);
+	std::vector<std::string> expected;
+	std::vector<std::string_view> got;
+	std::string line;
+	
+	for (int n = 0; n < iterations; n++) {
+		line.clear();
+		int length = rng() % 24;
+		for (int i = 0; i < length; i++) {
+			line+= alphabet[rng() % sizeof(alphabet)];
+		}
+		
+		explodeLegacy(line, ' ', expected);
+		explode(line, ' ', got);
+		
+		bool same = expected.size() == got.size();
+		for (size_t i = 0; same && i < got.size(); i++) {
+			same = expected[i] == got[i];
+		}
+		if (!same) {
+			return "tokenizer differs on [" + line + "]";
+		}
+	}
+	return "tokenizer ok, " + std::to_string(iterations) + " lines";
+}
@@ -19,6 +19,7 @@ void testApp::setup(){
 	terminal.addFunction("speed", &testApp::setSpeed);
 	terminal.addFunction("blink", &testApp::blink);
 	terminal.addFunction("ps1", &testApp::setPS1);
+	terminal.addFunction("selftest", &testApp::selfTest);
 	
 }
 
@@ -59,43 +60,55 @@ void testApp::keyPressed(int key){
 	terminal.keyPressed(key);
 }
 
-string testApp::setFrequency(vector<string> args) {
+string testApp::setFrequency(ofxTerminalArgs args) {
 	
 	if (args.size() < 1) {
 		return "usage: frequency f";
 	}
 
-	frequency = ofToFloat(args[0]);
+	frequency = args[0].toFloat();
 	return "";
 }
 
 // here we have an example where the user can reveive feedback based on the input
-string testApp::setAmplitude(vector<string> args) {
+string testApp::setAmplitude(ofxTerminalArgs args) {
 	
-	//ofToFloat returns 0 if something other than a number is passed to it,
+	if (args.size() < 1) {
+		return "usage: amplitude a";
+	}
+	
+	//toFloat returns 0 if something other than a number is passed to it,
 	//so alert the user...
-	if (!ofToFloat(args[0])) {
-		return args[0] + " is not a number";
+	if (!args[0].toFloat()) {
+		return args[0].str() + " is not a number";
 	}
 	
-	amplitude = ofToFloat(args[0]);
+	amplitude = args[0].toFloat();
 
 	return "";
 }
 
-string testApp::setLength(vector<string> args) {
+string testApp::setLength(ofxTerminalArgs args) {
+	
+	if (args.size() < 1) {
+		return "usage: length l";
+	}
 	
-	length = ofToInt(args[0]);
+	length = args[0].toInt();
 	return "";
 }
 
-string testApp::setSpeed(vector<string> args) {
+string testApp::setSpeed(ofxTerminalArgs args) {
+	
+	if (args.size() < 1) {
+		return "usage: speed s";
+	}
 	
-	speed = ofToFloat(args[0]);	
+	speed = args[0].toFloat();
 	return "";
 }
 
-string testApp::blink(vector<string> args) {
+string testApp::blink(ofxTerminalArgs args) {
 
     if (args.size() != 1) {
         return "usage: blink on|off";
@@ -108,14 +121,23 @@ string testApp::blink(vector<string> args) {
 		terminal.setBlinkingCursor(false);
 	}
 	else {
-		return "don't understand " + args[0];
+		return "don't understand " + args[0].str();
 	}
 
 	return "";
 }
 
-string testApp::setPS1(vector<string> args) {
+string testApp::setPS1(ofxTerminalArgs args) {
 
-	terminal.setPS1(args[0]);
+	if (args.size() < 1) {
+		return "usage: ps1 prompt";
+	}
+	
+	terminal.setPS1(args[0].str());
 	return "";
-}
\ No newline at end of file
+}
+
+string testApp::selfTest(ofxTerminalArgs args) {
+
+	return terminal.checkTokenizer();
+}
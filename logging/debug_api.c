@@ -1,6 +1,19 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 
 #include "debug_api.h"
 
@@ -14,95 +27,1022 @@ void __no_implementation(OS_SPECIFIC_MUTEX mutex, const char* action_desc)
 }
 #endif
 
-#define MAX_LEVEL  20
 typedef int bool;
 
 static OS_SPECIFIC_MUTEX __mutex = NULL;
 
 static bool g_need_source_info = 0;
 static bool g_need_lock        = 0;
-static int g_debug_level[MAX_LEVEL] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
-static int g_debug_level_count = 0;
+/*
+ * Множество включенных уровней: бит level слова level / 64. Проверка уровня
+ * - одно чтение слова и проверка бита, изменения - атомарные операции.
+ */
+unsigned long long g_debug_level_mask[DEBUG_LEVEL_WORDS] = {0};
 
-static void __api_lock_mutex(void) { OS_SPECIFIC_MUTEX_WAIT(__mutex);  }
-static void __api_unlock_mutex(void) { OS_SPECIFIC_MUTEX_RELEASE(__mutex); }
+/*
+ * Асинхронный режим: кольцевой буфер записей. Запись с номером pos свободна,
+ * когда ее seq == pos, и готова к выводу, когда seq == pos + 1. Писатели
+ * занимают позиции атомарным сравнением с обменом g_async_tail, читатель один
+ * и двигает g_async_head.
+ */
 
+#define ASYNC_BATCH_SIZE (64 * 1024)
 
-static int get_debug_level() {
-    if (g_debug_level_count == 0) {
-        printf("logger: no debug level is set\n");
-    } else {
-        for (int i = 0; i < g_debug_level_count; i++) {
-            printf("logger: debug_level[%d] = %d\n", i, g_debug_level[i]);
+typedef struct {
+    unsigned long seq;
+    unsigned short len;
+    char text[DEBUG_RECORD_SIZE];
+} async_record;
+
+static async_record* g_async_ring = NULL;
+static char* g_async_batch = NULL;          /* пакет фонового потока */
+static unsigned long g_async_mask = 0;
+static unsigned long g_async_tail = 0;      /* следующая позиция для писателей */
+static unsigned long g_async_head = 0;      /* следующая позиция для читателя */
+static unsigned long g_async_dropped = 0;
+static int g_async_enabled = 0;
+static int g_async_stop = 0;
+static int g_async_fd = -1;
+static int g_async_own_fd = 0;
+static debug_overflow_policy g_async_policy = DEBUG_OVERFLOW_DROP;
+static pthread_t g_async_thread;
+static int g_async_atexit = 0;
+
+static __thread char tls_record[DEBUG_RECORD_SIZE];
+
+static void async_sleep(long ns)
+{
+    struct timespec ts = { 0, ns };
+    nanosleep(&ts, NULL);
+}
+
+static void async_write(const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = write(g_async_fd, data, size);
+        if (n <= 0) return;
+        data += n;
+        size -= n;
+    }
+}
+
+/* Кладет запись в кольцо. Возвращает 0, если запись потеряна. */
+static int async_push(const char* text, size_t len)
+{
+    unsigned long pos = __atomic_load_n(&g_async_tail, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        async_record* rec = &g_async_ring[pos & g_async_mask];
+        unsigned long seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+        long dif = (long)(seq - pos);
+        if (dif == 0)
+        {
+            if (__atomic_compare_exchange_n(&g_async_tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                memcpy(rec->text, text, len);
+                rec->len = (unsigned short)len;
+                __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        }
+        else if (dif < 0)
+        {
+            /* кольцо заполнено */
+            if (g_async_policy == DEBUG_OVERFLOW_DROP)
+            {
+                __atomic_fetch_add(&g_async_dropped, 1, __ATOMIC_RELAXED);
+                return 0;
+            }
+            sched_yield();
+            pos = __atomic_load_n(&g_async_tail, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            pos = __atomic_load_n(&g_async_tail, __ATOMIC_RELAXED);
         }
     }
 }
 
-int set_debug_level(int level)
+/* Фоновый поток: собирает готовые записи в пакет и выводит его одним write. */
+static void* async_writer(void* arg)
+{
+    char* batch = g_async_batch;
+    size_t used = 0;
+    long idle = 0;
+    (void)arg;
+
+    for (;;)
+    {
+        unsigned long pos = g_async_head;
+        async_record* rec = &g_async_ring[pos & g_async_mask];
+        if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) == pos + 1)
+        {
+            if (used + rec->len > ASYNC_BATCH_SIZE)
+            {
+                async_write(batch, used);
+                used = 0;
+            }
+            memcpy(batch + used, rec->text, rec->len);
+            used += rec->len;
+            __atomic_store_n(&rec->seq, pos + g_async_mask + 1, __ATOMIC_RELEASE);
+            __atomic_store_n(&g_async_head, pos + 1, __ATOMIC_RELEASE);
+            idle = 0;
+            continue;
+        }
+
+        /* новых записей нет: выводим накопленное и ждем */
+        if (used > 0)
+        {
+            async_write(batch, used);
+            used = 0;
+        }
+        if (__atomic_load_n(&g_async_stop, __ATOMIC_ACQUIRE)
+            && __atomic_load_n(&g_async_tail, __ATOMIC_ACQUIRE) == pos)
+        {
+            break;
+        }
+        if (idle < 100) { idle++; sched_yield(); }
+        else async_sleep(1000000);
+    }
+    return NULL;
+}
+
+static void async_free(void)
+{
+    free(g_async_ring);
+    g_async_ring = NULL;
+    free(g_async_batch);
+    g_async_batch = NULL;
+}
+
+/* Останавливает фоновый поток, выведя все записи. Возвращает 0, если режим не был включен. */
+static int async_shutdown(void)
 {
-    for (int i = 0; i < MAX_LEVEL; i++)
+    if (!__atomic_load_n(&g_async_enabled, __ATOMIC_ACQUIRE)) return 0;
+    __atomic_store_n(&g_async_enabled, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_async_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(g_async_thread, NULL);
+    if (g_async_own_fd) close(g_async_fd);
+    g_async_fd = -1;
+    return 1;
+}
+
+/*
+ * При выходе другие потоки еще могут писать в лог и класть записи в кольцо,
+ * поэтому оно не освобождается.
+ */
+static void async_exit(void)
+{
+    async_shutdown();
+}
+
+int debug_async_start(const char* path, unsigned records, debug_overflow_policy policy)
+{
+    unsigned long size = 2;
+    unsigned long i;
+
+    if (g_async_enabled) return -1;
+    while (size < records) size <<= 1;
+
+    g_async_ring = (async_record*)calloc(size, sizeof(async_record));
+    g_async_batch = (char*)malloc(ASYNC_BATCH_SIZE);
+    if (!g_async_ring || !g_async_batch)
     {
-        g_debug_level[i] = 0;
+        async_free();
+        return -1;
     }
-    if (level == 0)
+    for (i = 0; i < size; i++) g_async_ring[i].seq = i;
+    g_async_mask = size - 1;
+    g_async_head = g_async_tail = 0;
+    g_async_dropped = 0;
+    g_async_stop = 0;
+    g_async_policy = policy;
+
+    g_async_own_fd = (path != NULL);
+    g_async_fd = path ? open(path, O_WRONLY | O_CREAT | O_APPEND, 0644) : 2;
+    if (g_async_fd < 0 || pthread_create(&g_async_thread, NULL, async_writer, NULL) != 0)
     {
-        g_debug_level_count = 0;
+        if (g_async_own_fd && g_async_fd >= 0) close(g_async_fd);
+        async_free();
+        return -1;
     }
-    else
+    if (!g_async_atexit)
     {
-        g_debug_level_count = 1;
-        g_debug_level[0] = level;
+        atexit(async_exit);
+        g_async_atexit = 1;
     }
-    get_debug_level();
+    fflush(stderr);
+    __atomic_store_n(&g_async_enabled, 1, __ATOMIC_RELEASE);
+    return 0;
 }
 
-void add_debug_level(int level)
+void debug_async_flush(void)
 {
-    int i = 0;
-    for (i = 0; i < g_debug_level_count; i++) {
-        if (level > g_debug_level[i])  continue;
-        if (level == g_debug_level[i]) return;
-        break;
+    unsigned long tail;
+    if (!__atomic_load_n(&g_async_enabled, __ATOMIC_ACQUIRE)) return;
+    tail = __atomic_load_n(&g_async_tail, __ATOMIC_ACQUIRE);
+    while ((long)(__atomic_load_n(&g_async_head, __ATOMIC_ACQUIRE) - tail) < 0)
+    {
+        async_sleep(100000);
+    }
+}
+
+/*
+ * Вызывающий должен убедиться, что другие потоки больше не пишут в лог.
+ */
+void debug_async_stop(void)
+{
+    if (async_shutdown()) async_free();
+}
+
+unsigned long debug_async_dropped(void)
+{
+    return __atomic_load_n(&g_async_dropped, __ATOMIC_RELAXED);
+}
+
+/*
+ * Двоичный режим. Вместо форматирования в лог пишется запись события:
+ * указатель на форматную строку, время и значения аргументов как есть.
+ * Текст восстанавливается позже функцией debug_binary_decode.
+ *
+ * Формат файла: заголовок BINARY_MAGIC, затем записи двух видов.
+ *   словарь: u8 BINARY_DICT, u64 указатель, u32 длина, строка
+ *   событие: u8 BINARY_EVENT, u64 формат, u64 файл (0 - без источника),
+ *            u32 строка, u64 время в нс, u32 размер аргументов, аргументы
+ * Строка словаря пишется, когда указатель встречается впервые. Аргументы
+ * идут в порядке форматной строки: '*' - int, целые - 4 или 8 байт,
+ * double - 8 байт, long double - sizeof(long double), %s - u16 длина и
+ * байты строки. Числа записываются в порядке байт машины.
+ */
+
+#define BINARY_MAGIC        "DBGBIN1\n"
+#define BINARY_DICT         1
+#define BINARY_EVENT        2
+#define BINARY_BUFFER_SIZE  (64 * 1024)
+#define BINARY_MAX_STRING   1024
+#define BINARY_SEEN_SIZE    4096
+
+enum {
+    ARG_NONE = 0,
+    ARG_INT,        /* int и все, что до него расширяется */
+    ARG_LONG,
+    ARG_LLONG,
+    ARG_SIZE,
+    ARG_INTMAX,
+    ARG_PTRDIFF,
+    ARG_DOUBLE,
+    ARG_LDOUBLE,
+    ARG_PTR,
+    ARG_STR,
+    ARG_COUNT       /* %n: аргумент пропускается */
+};
+
+typedef struct binary_buffer {
+    char* data;
+    size_t used;
+    struct binary_buffer* next;
+} binary_buffer;
+
+static int g_binary_enabled = 0;
+static int g_binary_fd = -1;
+static int g_binary_atexit = 0;
+static const void* g_binary_seen[BINARY_SEEN_SIZE];
+static binary_buffer* g_binary_buffers = NULL;
+static pthread_mutex_t g_binary_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t g_binary_key;
+static pthread_once_t g_binary_once = PTHREAD_ONCE_INIT;
+static __thread binary_buffer* tls_binary = NULL;
+
+/*
+ * Разбирает очередную спецификацию формата. Возвращает указатель на ее
+ * начало ('%') или NULL, если спецификаций больше нет; в *end - указатель
+ * за ней, в *stars - число '*', в *type - тип аргумента.
+ */
+static const char* next_spec(const char* fmt, const char** end, int* stars, int* type)
+{
+    for (;;)
+    {
+        const char* p = strchr(fmt, '%');
+        const char* begin = p;
+        int lng = 0;    /* 1 - l, 2 - ll, 3 - L, 4 - z, 5 - j, 6 - t */
+        if (!p) return NULL;
+        p++;
+        if (*p == '%') { fmt = p + 1; continue; }
+
+        *stars = 0;
+        while (*p && strchr("-+ #0'", *p)) p++;
+        if (*p == '*') { (*stars)++; p++; }
+        else while (*p >= '0' && *p <= '9') p++;
+        if (*p == '.')
+        {
+            p++;
+            if (*p == '*') { (*stars)++; p++; }
+            else while (*p >= '0' && *p <= '9') p++;
+        }
+        for (; *p && strchr("hlLqzjt", *p); p++)
+        {
+            switch (*p)
+            {
+                case 'l': lng = (lng == 1) ? 2 : 1; break;
+                case 'q': lng = 2; break;
+                case 'L': lng = 3; break;
+                case 'z': lng = 4; break;
+                case 'j': lng = 5; break;
+                case 't': lng = 6; break;
+                default: break; /* h, hh: аргумент все равно int */
+            }
+        }
+        switch (*p)
+        {
+            case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+                *type = (lng == 1) ? ARG_LONG : (lng == 2 || lng == 3) ? ARG_LLONG :
+                        (lng == 4) ? ARG_SIZE : (lng == 5) ? ARG_INTMAX :
+                        (lng == 6) ? ARG_PTRDIFF : ARG_INT;
+                break;
+            case 'c':
+                *type = ARG_INT;
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                *type = (lng == 3) ? ARG_LDOUBLE : ARG_DOUBLE;
+                break;
+            case 'p':
+                *type = ARG_PTR;
+                break;
+            case 's':
+                *type = ARG_STR;
+                break;
+            case 'n':
+                *type = ARG_COUNT;
+                break;
+            default:
+                /* неизвестная спецификация: дальше формат не разбираем */
+                *type = ARG_NONE;
+                *end = p;
+                return begin;
+        }
+        *end = p + 1;
+        return begin;
+    }
+}
+
+static void binary_write(const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = write(g_binary_fd, data, size);
+        if (n <= 0) return;
+        data += n;
+        size -= n;
+    }
+}
+
+static void binary_flush(binary_buffer* buf)
+{
+    if (buf->used > 0 && g_binary_fd >= 0)
+    {
+        binary_write(buf->data, buf->used);
+    }
+    buf->used = 0;
+}
+
+/* Поток завершается: выводим его буфер и убираем из списка. */
+static void binary_thread_exit(void* arg)
+{
+    binary_buffer* buf = (binary_buffer*)arg;
+    binary_buffer** pp;
+    pthread_mutex_lock(&g_binary_lock);
+    binary_flush(buf);
+    for (pp = &g_binary_buffers; *pp; pp = &(*pp)->next)
+    {
+        if (*pp == buf) { *pp = buf->next; break; }
+    }
+    pthread_mutex_unlock(&g_binary_lock);
+    free(buf->data);
+    free(buf);
+}
+
+static void binary_make_key(void)
+{
+    pthread_key_create(&g_binary_key, binary_thread_exit);
+}
+
+static binary_buffer* binary_thread_buffer(void)
+{
+    binary_buffer* buf = tls_binary;
+    if (buf) return buf;
+
+    buf = (binary_buffer*)calloc(1, sizeof(binary_buffer));
+    if (!buf) return NULL;
+    buf->data = (char*)malloc(BINARY_BUFFER_SIZE);
+    if (!buf->data) { free(buf); return NULL; }
+
+    pthread_once(&g_binary_once, binary_make_key);
+    pthread_setspecific(g_binary_key, buf);
+    pthread_mutex_lock(&g_binary_lock);
+    buf->next = g_binary_buffers;
+    g_binary_buffers = buf;
+    pthread_mutex_unlock(&g_binary_lock);
+    tls_binary = buf;
+    return buf;
+}
+
+static void put_bytes(binary_buffer* buf, const void* data, size_t size)
+{
+    memcpy(buf->data + buf->used, data, size);
+    buf->used += size;
+}
+
+/* Записывает строку в словарь, если указатель встречается впервые. */
+static void binary_dict(binary_buffer* buf, const char* str)
+{
+    unsigned long long key = (unsigned long long)(size_t)str;
+    unsigned h = (unsigned)((key >> 3) * 2654435761u) % BINARY_SEEN_SIZE;
+    unsigned i;
+    unsigned char kind = BINARY_DICT;
+    unsigned int len;
+
+    for (i = 0; i < BINARY_SEEN_SIZE; i++, h = (h + 1) % BINARY_SEEN_SIZE)
+    {
+        const void* seen = __atomic_load_n(&g_binary_seen[h], __ATOMIC_ACQUIRE);
+        if (seen == str) return;
+        if (seen == NULL)
+        {
+            const void* expected = NULL;
+            if (__atomic_compare_exchange_n(&g_binary_seen[h], &expected, (const void*)str, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                break;
+            if (expected == str) return;
+        }
     }
-    if (i == g_debug_level_count)
+    /* таблица заполнена: строка пишется каждый раз, декодер это допускает */
+
+    len = (unsigned int)strlen(str);
+    if (buf->used + 1 + 8 + 4 + len > BINARY_BUFFER_SIZE) binary_flush(buf);
+    if (1 + 8 + 4 + len > BINARY_BUFFER_SIZE)
     {
-        g_debug_level[i] = level;
+        binary_write((const char*)&kind, 1);
+        binary_write((const char*)&key, 8);
+        binary_write((const char*)&len, 4);
+        binary_write(str, len);
+        return;
     }
-    else
+    put_bytes(buf, &kind, 1);
+    put_bytes(buf, &key, 8);
+    put_bytes(buf, &len, 4);
+    put_bytes(buf, str, len);
+}
+
+/* Наибольший размер записи события при данной форматной строке. */
+static size_t binary_event_size(const char* fmt)
+{
+    size_t size = 1 + 8 + 8 + 4 + 8 + 4;
+    const char* end;
+    int stars, type;
+    while ((fmt = next_spec(fmt, &end, &stars, &type)) != NULL)
     {
-        for (int j = g_debug_level_count; j > i; j--)
+        size += stars * sizeof(int);
+        if (type == ARG_STR) size += 2 + BINARY_MAX_STRING;
+        else if (type == ARG_LDOUBLE) size += sizeof(long double);
+        else size += 8;
+        if (type == ARG_NONE) break;
+        fmt = end;
+    }
+    return size;
+}
+
+static void binary_event(const char* file, int line, const char* fmt, va_list args)
+{
+    binary_buffer* buf = binary_thread_buffer();
+    unsigned char kind = BINARY_EVENT;
+    unsigned long long ptr;
+    unsigned int line_number = (unsigned int)line;
+    unsigned long long ns;
+    struct timespec ts;
+    size_t args_at;
+    unsigned int args_size;
+    const char* spec = fmt;
+    const char* end;
+    int stars, type;
+
+    if (!buf) return;
+    if (binary_event_size(fmt) > BINARY_BUFFER_SIZE) return;
+
+    binary_dict(buf, fmt);
+    if (file) binary_dict(buf, file);
+    if (buf->used + binary_event_size(fmt) > BINARY_BUFFER_SIZE) binary_flush(buf);
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ns = (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+    put_bytes(buf, &kind, 1);
+    ptr = (unsigned long long)(size_t)fmt;
+    put_bytes(buf, &ptr, 8);
+    ptr = (unsigned long long)(size_t)file;
+    put_bytes(buf, &ptr, 8);
+    put_bytes(buf, &line_number, 4);
+    put_bytes(buf, &ns, 8);
+    args_at = buf->used;
+    buf->used += 4;
+
+    while ((spec = next_spec(spec, &end, &stars, &type)) != NULL && type != ARG_NONE)
+    {
+        for (int i = 0; i < stars; i++)
         {
-            g_debug_level[j] = g_debug_level[j-1];
+            int v = va_arg(args, int);
+            put_bytes(buf, &v, sizeof(v));
         }
-        g_debug_level[i] = level;
+        switch (type)
+        {
+            case ARG_INT:     { int v = va_arg(args, int); put_bytes(buf, &v, sizeof(v)); break; }
+            case ARG_LONG:    { long long v = va_arg(args, long); put_bytes(buf, &v, 8); break; }
+            case ARG_LLONG:   { long long v = va_arg(args, long long); put_bytes(buf, &v, 8); break; }
+            case ARG_SIZE:    { unsigned long long v = va_arg(args, size_t); put_bytes(buf, &v, 8); break; }
+            case ARG_INTMAX:  { long long v = va_arg(args, intmax_t); put_bytes(buf, &v, 8); break; }
+            case ARG_PTRDIFF: { long long v = va_arg(args, ptrdiff_t); put_bytes(buf, &v, 8); break; }
+            case ARG_DOUBLE:  { double v = va_arg(args, double); put_bytes(buf, &v, 8); break; }
+            case ARG_LDOUBLE: { long double v = va_arg(args, long double); put_bytes(buf, &v, sizeof(v)); break; }
+            case ARG_PTR:     { unsigned long long v = (size_t)va_arg(args, void*); put_bytes(buf, &v, 8); break; }
+            case ARG_COUNT:   { (void)va_arg(args, void*); break; }
+            case ARG_STR:
+            {
+                const char* s = va_arg(args, const char*);
+                size_t n = s ? strlen(s) : 6;
+                unsigned short len;
+                if (!s) s = "(null)";
+                len = (unsigned short)(n > BINARY_MAX_STRING ? BINARY_MAX_STRING : n);
+                put_bytes(buf, &len, 2);
+                put_bytes(buf, s, len);
+                break;
+            }
+        }
+        spec = end;
     }
-    g_debug_level_count++;
-    get_debug_level();
+    args_size = (unsigned int)(buf->used - args_at - 4);
+    memcpy(buf->data + args_at, &args_size, 4);
 }
 
-int check_debug_level(int level)
+int debug_binary_start(const char* path)
 {
-    if (g_debug_level_count == 0) return -1;
-    for (int i = 0; i < g_debug_level_count; i++) {
-        if (level > g_debug_level[i])  continue;
-        if (level == g_debug_level[i]) return i;
+    if (g_binary_enabled || !path) return -1;
+    g_binary_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (g_binary_fd < 0) return -1;
+    binary_write(BINARY_MAGIC, sizeof(BINARY_MAGIC) - 1);
+    memset((void*)g_binary_seen, 0, sizeof(g_binary_seen));
+    if (!g_binary_atexit)
+    {
+        atexit(debug_binary_stop);
+        g_binary_atexit = 1;
+    }
+    __atomic_store_n(&g_binary_enabled, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*
+ * Вызывающий должен убедиться, что другие потоки больше не пишут в лог.
+ */
+void debug_binary_stop(void)
+{
+    binary_buffer* buf;
+    if (!__atomic_load_n(&g_binary_enabled, __ATOMIC_ACQUIRE)) return;
+    __atomic_store_n(&g_binary_enabled, 0, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&g_binary_lock);
+    for (buf = g_binary_buffers; buf; buf = buf->next)
+    {
+        binary_flush(buf);
+    }
+    close(g_binary_fd);
+    g_binary_fd = -1;
+    pthread_mutex_unlock(&g_binary_lock);
+}
+
+/*
+ * Декодер. Сначала собирается словарь всего файла (строки словаря из разных
+ * потоков могут оказаться в файле позже событий), затем события выводятся
+ * по одному: каждая спецификация форматируется отдельным вызовом snprintf.
+ */
+
+typedef struct {
+    unsigned long long ptr;
+    const char* str;
+} dict_entry;
+
+static const char* dict_find(const dict_entry* dict, size_t count, unsigned long long ptr)
+{
+    for (size_t i = count; i-- > 0;)
+    {
+        if (dict[i].ptr == ptr) return dict[i].str;
+    }
+    return NULL;
+}
+
+/* Выводит текст формата между спецификациями, %% как % */
+static void put_literal(FILE* out, const char* from, const char* to)
+{
+    for (; from < to; from++)
+    {
+        if (from[0] == '%' && from + 1 < to && from[1] == '%') from++;
+        fputc(*from, out);
+    }
+}
+
+#define GET(dst, n) do { if ((size_t)(end - p) < (size_t)(n)) goto truncated; memcpy((dst), p, (n)); p += (n); } while (0)
+
+int debug_binary_decode(const char* path, FILE* out, int with_time)
+{
+    FILE* in = fopen(path, "rb");
+    char* data = NULL;
+    long size;
+    const char* p;
+    const char* end;
+    dict_entry* dict = NULL;
+    size_t dict_count = 0, dict_cap = 0;
+    char* dict_strings = NULL;
+    int pass, events = 0;
+
+    if (!in) return -1;
+    fseek(in, 0, SEEK_END);
+    size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    data = (char*)malloc(size > 0 ? size + 1 : 1);
+    if (!data || size < (long)sizeof(BINARY_MAGIC) - 1 || fread(data, 1, size, in) != (size_t)size
+        || memcmp(data, BINARY_MAGIC, sizeof(BINARY_MAGIC) - 1) != 0)
+    {
+        fclose(in);
+        free(data);
         return -1;
     }
+    fclose(in);
+    /* строки словаря храним с нулем в конце, поэтому копируем их отдельно */
+    dict_strings = (char*)malloc(size + 1);
+    if (!dict_strings) goto truncated;
+    end = data + size;
+
+    for (pass = 0; pass < 2; pass++)
+    {
+        char* strings = dict_strings;
+        p = data + sizeof(BINARY_MAGIC) - 1;
+        while (p < end)
+        {
+            unsigned char kind;
+            GET(&kind, 1);
+            if (kind == BINARY_DICT)
+            {
+                unsigned long long ptr;
+                unsigned int len;
+                GET(&ptr, 8);
+                GET(&len, 4);
+                if (len > (size_t)(end - p)) goto truncated;
+                if (pass == 0)
+                {
+                    if (dict_count == dict_cap)
+                    {
+                        size_t cap = dict_cap ? dict_cap * 2 : 64;
+                        dict_entry* grown = (dict_entry*)realloc(dict, cap * sizeof(dict_entry));
+                        if (!grown) goto truncated;
+                        dict = grown;
+                        dict_cap = cap;
+                    }
+                    memcpy(strings, p, len);
+                    strings[len] = '\0';
+                    dict[dict_count].ptr = ptr;
+                    dict[dict_count].str = strings;
+                    dict_count++;
+                    strings += len + 1;
+                }
+                p += len;
+            }
+            else if (kind == BINARY_EVENT)
+            {
+                unsigned long long fmt_ptr, file_ptr, ns;
+                unsigned int line, args_size;
+                const char* fmt;
+                const char* file;
+                const char* spec;
+                const char* spec_end;
+                int stars, type;
+
+                GET(&fmt_ptr, 8);
+                GET(&file_ptr, 8);
+                GET(&line, 4);
+                GET(&ns, 8);
+                GET(&args_size, 4);
+                if (args_size > (size_t)(end - p)) goto truncated;
+                if (pass == 0)
+                {
+                    p += args_size;
+                    continue;
+                }
+                fmt = dict_find(dict, dict_count, fmt_ptr);
+                file = file_ptr ? dict_find(dict, dict_count, file_ptr) : NULL;
+                if (!fmt) goto truncated;
+
+                if (with_time)
+                {
+                    fprintf(out, "[%llu.%09llu] ", ns / 1000000000ULL, ns % 1000000000ULL);
+                }
+                spec = fmt;
+                while ((spec = next_spec(fmt, &spec_end, &stars, &type)) != NULL && type != ARG_NONE)
+                {
+                    char one[64];
+                    int star[2] = { 0, 0 };
+                    size_t n = spec_end - spec;
+                    put_literal(out, fmt, spec);
+                    for (int i = 0; i < stars; i++) GET(&star[i], sizeof(int));
+                    if (n >= sizeof(one)) n = sizeof(one) - 1;
+                    memcpy(one, spec, n);
+                    one[n] = '\0';
+
+#define EMIT(v) \
+    do { \
+        if (stars == 0) fprintf(out, one, v); \
+        else if (stars == 1) fprintf(out, one, star[0], v); \
+        else fprintf(out, one, star[0], star[1], v); \
+    } while (0)
+
+                    switch (type)
+                    {
+                        case ARG_INT:     { int v; GET(&v, sizeof(v)); EMIT(v); break; }
+                        case ARG_LONG:    { long long v; GET(&v, 8); EMIT((long)v); break; }
+                        case ARG_LLONG:   { long long v; GET(&v, 8); EMIT(v); break; }
+                        case ARG_SIZE:    { unsigned long long v; GET(&v, 8); EMIT((size_t)v); break; }
+                        case ARG_INTMAX:  { long long v; GET(&v, 8); EMIT((intmax_t)v); break; }
+                        case ARG_PTRDIFF: { long long v; GET(&v, 8); EMIT((ptrdiff_t)v); break; }
+                        case ARG_DOUBLE:  { double v; GET(&v, 8); EMIT(v); break; }
+                        case ARG_LDOUBLE: { long double v; GET(&v, sizeof(v)); EMIT(v); break; }
+                        case ARG_PTR:     { unsigned long long v; GET(&v, 8); EMIT((void*)(size_t)v); break; }
+                        case ARG_COUNT:   break;
+                        case ARG_STR:
+                        {
+                            unsigned short len;
+                            char s[BINARY_MAX_STRING + 1];
+                            GET(&len, 2);
+                            /* писатель обрезает строки, больше быть не может */
+                            if (len > BINARY_MAX_STRING) goto truncated;
+                            GET(s, len);
+                            s[len] = '\0';
+                            EMIT(s);
+                            break;
+                        }
+                    }
+#undef EMIT
+                    fmt = spec_end;
+                }
+                put_literal(out, fmt, fmt + strlen(fmt));
+                if (file) fprintf(out, "\t\t\t%s (%u)\r\n", file, line);
+                events++;
+            }
+            else
+            {
+                goto truncated;
+            }
+        }
+    }
+    free(dict);
+    free(dict_strings);
+    free(data);
+    return events;
+
+truncated:
+    free(dict);
+    free(dict_strings);
+    free(data);
     return -1;
 }
 
-void remove_debug_level(int level)
+#undef GET
+
+/*
+ * Блокировка синхронного режима. Счетчики меняются атомарно, потому что в
+ * режиме DEBUG_LOCK_NONE их увеличивают несколько потоков сразу. Время
+ * ожидания измеряется только для захватов, которые не прошли с первой
+ * попытки, поэтому свободная блокировка обходится без clock_gettime.
+ */
+
+struct os_lock
+{
+    debug_lock_kind kind;
+    pthread_mutex_t mutex;
+    int state;                  /* адаптивная: 0 свободна, 1 занята, 2 есть спящие */
+    unsigned long long acquisitions;
+    unsigned long long contended;
+    unsigned long long wait_ns;
+};
+
+static debug_lock_kind g_lock_kind = DEBUG_LOCK_MUTEX;
+
+int debug_set_lock_kind(debug_lock_kind kind)
+{
+    if (__atomic_load_n(&__mutex, __ATOMIC_ACQUIRE)) return -1;
+    g_lock_kind = kind;
+    return 0;
+}
+
+void debug_lock_stats_get(debug_lock_stats* stats)
+{
+    struct os_lock* lock = __atomic_load_n((struct os_lock**)&__mutex, __ATOMIC_ACQUIRE);
+    memset(stats, 0, sizeof(*stats));
+    if (!lock) return;
+    stats->acquisitions = __atomic_load_n(&lock->acquisitions, __ATOMIC_RELAXED);
+    stats->contended    = __atomic_load_n(&lock->contended, __ATOMIC_RELAXED);
+    stats->wait_ns      = __atomic_load_n(&lock->wait_ns, __ATOMIC_RELAXED);
+}
+
+void debug_lock_stats_reset(void)
+{
+    struct os_lock* lock = __atomic_load_n((struct os_lock**)&__mutex, __ATOMIC_ACQUIRE);
+    if (!lock) return;
+    __atomic_store_n(&lock->acquisitions, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&lock->contended, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&lock->wait_ns, 0, __ATOMIC_RELAXED);
+}
+
+#if !defined(NO_IMPLEMENTED) && defined(__unix__)
+
+static unsigned long long monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void cpu_relax(void)
 {
-    int i = check_debug_level(level);
-    if (i < 0) return;
-    else {
-        for (int j = i; i < g_debug_level_count-1; j++)
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static void lock_park(int* addr, int value)
+{
+#ifdef __linux__
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+#else
+    (void)addr; (void)value;
+    sched_yield();
+#endif
+}
+
+static void lock_unpark(int* addr)
+{
+#ifdef __linux__
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+    (void)addr;
+#endif
+}
+
+static int adaptive_try_lock(struct os_lock* lock)
+{
+    int free_state = 0;
+    return __atomic_compare_exchange_n(&lock->state, &free_state, 1, 0,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+/*
+ * Три состояния, как у мьютекса на futex: освобождающий будит спящего,
+ * только если состояние было 2.
+ */
+static void adaptive_lock(struct os_lock* lock)
+{
+    int c;
+    for (int i = 0; i < DEBUG_LOCK_SPIN_COUNT; i++)
+    {
+        cpu_relax();
+        if (__atomic_load_n(&lock->state, __ATOMIC_RELAXED) == 0 && adaptive_try_lock(lock)) return;
+    }
+    c = __atomic_exchange_n(&lock->state, 2, __ATOMIC_ACQUIRE);
+    while (c != 0)
+    {
+        lock_park(&lock->state, 2);
+        c = __atomic_exchange_n(&lock->state, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+static void adaptive_unlock(struct os_lock* lock)
+{
+    if (__atomic_exchange_n(&lock->state, 0, __ATOMIC_RELEASE) == 2)
+    {
+        lock_unpark(&lock->state);
+    }
+}
+
+int os_mutex_create(OS_SPECIFIC_MUTEX* mutex)
+{
+    struct os_lock* lock = (struct os_lock*)calloc(1, sizeof(*lock));
+    OS_SPECIFIC_MUTEX expected = NULL;
+    if (!lock) return -1;
+    lock->kind = g_lock_kind;
+    if (pthread_mutex_init(&lock->mutex, NULL) != 0)
+    {
+        free(lock);
+        return -1;
+    }
+    /* блокировку могут создавать несколько потоков сразу, остается первая */
+    if (!__atomic_compare_exchange_n(mutex, &expected, (OS_SPECIFIC_MUTEX)lock, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        pthread_mutex_destroy(&lock->mutex);
+        free(lock);
+    }
+    return 0;
+}
+
+void os_mutex_wait(OS_SPECIFIC_MUTEX mutex)
+{
+    struct os_lock* lock = (struct os_lock*)mutex;
+    unsigned long long start;
+
+    if (!lock) return;          /* не удалось создать */
+    __atomic_fetch_add(&lock->acquisitions, 1, __ATOMIC_RELAXED);
+    switch (lock->kind)
+    {
+    case DEBUG_LOCK_MUTEX:
+        if (pthread_mutex_trylock(&lock->mutex) == 0) return;
+        start = monotonic_ns();
+        pthread_mutex_lock(&lock->mutex);
+        break;
+    case DEBUG_LOCK_ADAPTIVE:
+        if (adaptive_try_lock(lock)) return;
+        start = monotonic_ns();
+        adaptive_lock(lock);
+        break;
+    default:
+        return;
+    }
+    __atomic_fetch_add(&lock->contended, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&lock->wait_ns, monotonic_ns() - start, __ATOMIC_RELAXED);
+}
+
+void os_mutex_release(OS_SPECIFIC_MUTEX mutex)
+{
+    struct os_lock* lock = (struct os_lock*)mutex;
+    if (!lock) return;
+    switch (lock->kind)
+    {
+    case DEBUG_LOCK_MUTEX:
+        pthread_mutex_unlock(&lock->mutex);
+        break;
+    case DEBUG_LOCK_ADAPTIVE:
+        adaptive_unlock(lock);
+        break;
+    default:
+        break;
+    }
+}
+
+#endif
+
+static void __api_lock_mutex(void) { OS_SPECIFIC_MUTEX_WAIT(__atomic_load_n(&__mutex, __ATOMIC_ACQUIRE));  }
+static void __api_unlock_mutex(void) { OS_SPECIFIC_MUTEX_RELEASE(__atomic_load_n(&__mutex, __ATOMIC_ACQUIRE)); }
+
+
+static int get_debug_level() {
+    int count = 0;
+    for (int level = 0; level < DEBUG_LEVEL_COUNT; level++) {
+        if (debug_level_enabled(level)) {
+            printf("logger: debug_level[%d] = %d\n", count++, level);
+        }
+    }
+    if (count == 0) {
+        printf("logger: no debug level is set\n");
+    }
+    return count;
+}
+
+int set_debug_level(int level)
+{
+    for (int i = 0; i < DEBUG_LEVEL_WORDS; i++)
+    {
+        unsigned long long word = 0;
+        if (level > 0 && level < DEBUG_LEVEL_COUNT && level / 64 == i)
         {
-            g_debug_level[j] = g_debug_level[j+1];
+            word = 1ULL << (level % 64);
         }
-        g_debug_level[g_debug_level_count-1] = 0;
-        g_debug_level_count--;
+        __atomic_store_n(&g_debug_level_mask[i], word, __ATOMIC_RELAXED);
     }
+    return get_debug_level();
+}
+
+void add_debug_level(int level)
+{
+    if (level < 0 || level >= DEBUG_LEVEL_COUNT) return;
+    __atomic_fetch_or(&g_debug_level_mask[level / 64], 1ULL << (level % 64), __ATOMIC_RELAXED);
+    get_debug_level();
+}
+
+int check_debug_level(int level)
+{
+    return debug_level_enabled(level) ? 0 : -1;
+}
+
+void remove_debug_level(int level)
+{
+    if (!debug_level_enabled(level)) return;
+    __atomic_fetch_and(&g_debug_level_mask[level / 64], ~(1ULL << (level % 64)), __ATOMIC_RELAXED);
     get_debug_level();
 }
 
@@ -121,11 +1061,35 @@ void __debug_print(int log_level, char* file, int line_number, char* msg, ...)
     va_list(p);
     bool lv = 0;
 
-    if (check_debug_level(log_level) >= 0)
+    if (debug_level_enabled(log_level))
     {
+        if (__atomic_load_n(&g_binary_enabled, __ATOMIC_ACQUIRE))
+        {
+            va_start(p, msg);
+            binary_event(g_need_source_info ? file : NULL, line_number, msg, p);
+            va_end(p);
+            return;
+        }
+        if (__atomic_load_n(&g_async_enabled, __ATOMIC_ACQUIRE))
+        {
+            int len;
+            va_start(p, msg);
+            len = vsnprintf(tls_record, DEBUG_RECORD_SIZE, msg, p);
+            va_end(p);
+            if (len < 0) return;
+            if (len >= DEBUG_RECORD_SIZE) len = DEBUG_RECORD_SIZE - 1;
+            if (g_need_source_info && file && len < DEBUG_RECORD_SIZE - 1)
+            {
+                int n = snprintf(tls_record + len, DEBUG_RECORD_SIZE - len,
+                                 "\t\t\t%s (%d)\r\n", file, line_number);
+                len = (n < 0 || len + n >= DEBUG_RECORD_SIZE) ? DEBUG_RECORD_SIZE - 1 : len + n;
+            }
+            async_push(tls_record, len);
+            return;
+        }
         if (g_need_lock)
         {
-            if (!__mutex) OS_SPECIFIC_MUTEX_CREATE(&__mutex);
+            if (!__atomic_load_n(&__mutex, __ATOMIC_ACQUIRE)) OS_SPECIFIC_MUTEX_CREATE(&__mutex);
             __api_lock_mutex();
             lv = 1;
         }
@@ -11,6 +11,8 @@
 #ifndef _DEBUG_API_H
 #define _DEBUG_API_H
 
+#include <stdio.h>
+
 #if defined(__cplusplus)
 extern "C"
 {
@@ -30,17 +32,162 @@ extern void add_debug_level(int level);
 extern void remove_debug_level(int level);
 extern void set_need_source(int);
 extern int set_debug_level(int level);
+/**
+ * @brief Проверяет уровень логгирования.
+ * 
+ * @return 0, если уровень включен, иначе -1.
+ */
 extern int check_debug_level(int level);
 extern void allocate_mutex();
 
+/*
+ * Включенные уровни хранятся битовой маской, поддерживаются уровни
+ * от 0 до DEBUG_LEVEL_COUNT - 1.
+ */
+
+#define DEBUG_LEVEL_COUNT 256
+#define DEBUG_LEVEL_WORDS (DEBUG_LEVEL_COUNT / 64)
+
+extern unsigned long long g_debug_level_mask[DEBUG_LEVEL_WORDS];
+
+static inline int debug_level_enabled(int level)
+{
+    if ((unsigned)level >= DEBUG_LEVEL_COUNT) return 0;
+    return (int)((__atomic_load_n(&g_debug_level_mask[level / 64], __ATOMIC_RELAXED) >> (level % 64)) & 1);
+}
 
 /*
- * Для многопоточных программ реализуйте интерфейсы для мьютексов
+ * DEBUG_PRINT вычисляет аргументы, только если уровень включен. Уровни выше
+ * DEBUG_PRINT_MAX_LEVEL отбрасываются при компиляции, если level - константа.
  */
 
-typedef void*                       OS_SPECIFIC_MUTEX;
+#ifndef DEBUG_PRINT_MAX_LEVEL
+#define DEBUG_PRINT_MAX_LEVEL (DEBUG_LEVEL_COUNT - 1)
+#endif
+
+#define DEBUG_PRINT(level, ...) \
+    do { \
+        if ((level) <= DEBUG_PRINT_MAX_LEVEL && debug_level_enabled(level)) \
+            __debug_print((level), __FILE__, __LINE__, __VA_ARGS__); \
+    } while (0)
+
+/*
+ * Асинхронный режим.
+ *
+ * Сообщение форматируется в буфер потока и кладется в кольцевой буфер без
+ * блокировок (много писателей, один читатель). Фоновый поток забирает записи
+ * и пишет их большими блоками, поэтому вызов __debug_print обходится без
+ * системных вызовов. Сообщения длиннее DEBUG_RECORD_SIZE обрезаются.
+ */
+
+#define DEBUG_RECORD_SIZE 256
+
+typedef enum {
+    DEBUG_OVERFLOW_DROP = 0,    /* при переполнении сообщение теряется */
+    DEBUG_OVERFLOW_BLOCK        /* при переполнении писатель ждет места */
+} debug_overflow_policy;
+
+/**
+ * @brief Включает асинхронный режим.
+ * 
+ * @param path Файл для вывода (дописывается в конец) или NULL для stderr.
+ * @param records Размер кольцевого буфера в записях, округляется до степени двойки.
+ * @param policy Что делать, если буфер заполнен.
+ * @return 0 в случае успеха, -1 в случае ошибки.
+ */
+extern int debug_async_start(const char* path, unsigned records, debug_overflow_policy policy);
+/**
+ * @brief Выводит все накопленные сообщения, останавливает фоновый поток,
+ * освобождает буфер и возвращает синхронный режим. При выходе фоновый поток
+ * останавливается автоматически, но буфер остается: другие потоки еще могут
+ * в него писать.
+ */
+extern void debug_async_stop(void);
+/**
+ * @brief Ждет, пока будут выведены все сообщения, отправленные до вызова.
+ */
+extern void debug_async_flush(void);
+/**
+ * @brief Число сообщений, потерянных из-за переполнения.
+ */
+extern unsigned long debug_async_dropped(void);
+
+/*
+ * Двоичный режим.
+ *
+ * __debug_print не форматирует сообщение, а записывает в буфер потока адрес
+ * форматной строки, время и значения аргументов. Буфер сбрасывается в файл
+ * целиком. Текст получают потом декодером (debug_decode или
+ * debug_binary_decode). Форматные строки и имена файлов должны жить до
+ * конца программы (строковые литералы), строки %s копируются до 1024 байт.
+ * Двоичный режим важнее асинхронного, если включены оба.
+ */
+
+/**
+ * @brief Включает двоичный режим, файл перезаписывается.
+ * 
+ * @return 0 в случае успеха, -1 в случае ошибки.
+ */
+extern int debug_binary_start(const char* path);
+/**
+ * @brief Сбрасывает буферы всех потоков и закрывает файл. Вызывается
+ * автоматически при выходе.
+ */
+extern void debug_binary_stop(void);
+/**
+ * @brief Переводит двоичный лог в текст.
+ * 
+ * @param with_time Выводить время события в начале строки.
+ * @return Число событий или -1, если файл поврежден.
+ */
+extern int debug_binary_decode(const char* path, FILE* out, int with_time);
+
+
+/*
+ * Блокировка синхронного режима (включается allocate_mutex). Вид выбирается
+ * до первого сообщения:
+ *   DEBUG_LOCK_MUTEX    - мьютекс pthread;
+ *   DEBUG_LOCK_ADAPTIVE - сначала крутится DEBUG_LOCK_SPIN_COUNT попыток,
+ *                         потом поток засыпает (futex в Linux);
+ *   DEBUG_LOCK_NONE     - без блокировки, строки разных потоков могут
+ *                         перемешиваться.
+ * Для любого вида считается статистика захватов.
+ */
+
+#ifndef DEBUG_LOCK_SPIN_COUNT
+#define DEBUG_LOCK_SPIN_COUNT 100
+#endif
 
-#define NO_IMPLEMENTED
+typedef enum {
+    DEBUG_LOCK_MUTEX = 0,
+    DEBUG_LOCK_ADAPTIVE,
+    DEBUG_LOCK_NONE
+} debug_lock_kind;
+
+typedef struct {
+    unsigned long long acquisitions;    /* всего захватов */
+    unsigned long long contended;       /* захватов, которым пришлось ждать */
+    unsigned long long wait_ns;         /* суммарное время ожидания, нс */
+} debug_lock_stats;
+
+/**
+ * @brief Выбирает вид блокировки.
+ * 
+ * @return 0 в случае успеха, -1, если блокировка уже создана.
+ */
+extern int debug_set_lock_kind(debug_lock_kind kind);
+/**
+ * @brief Статистика блокировки с момента создания или последнего сброса.
+ */
+extern void debug_lock_stats_get(debug_lock_stats* stats);
+extern void debug_lock_stats_reset(void);
+
+/*
+ * Для многопоточных программ реализуйте интерфейсы для мьютексов.
+ * Заглушки, которые только печатают действие, включаются -DNO_IMPLEMENTED.
+ */
+
+typedef void*                       OS_SPECIFIC_MUTEX;
 
 #ifdef NO_IMPLEMENTED
     void __no_implementation(OS_SPECIFIC_MUTEX, const char* action_desc);
@@ -55,9 +202,12 @@ typedef void*                       OS_SPECIFIC_MUTEX;
         #define OS_SPECIFIC_MUTEX_WAIT              
         #define OS_SPECIFIC_MUTEX_RELEASE           
     #elif defined(__unix__)
-        #define OS_SPECIFIC_MUTEX_CREATE            
-        #define OS_SPECIFIC_MUTEX_WAIT              
-        #define OS_SPECIFIC_MUTEX_RELEASE           
+        int  os_mutex_create(OS_SPECIFIC_MUTEX* mutex);
+        void os_mutex_wait(OS_SPECIFIC_MUTEX mutex);
+        void os_mutex_release(OS_SPECIFIC_MUTEX mutex);
+        #define OS_SPECIFIC_MUTEX_CREATE(x)  os_mutex_create(x)
+        #define OS_SPECIFIC_MUTEX_WAIT(x)    os_mutex_wait(x)
+        #define OS_SPECIFIC_MUTEX_RELEASE(x) os_mutex_release(x)
     #else
         #error "API is not supported on this platfotm"
     #endif
@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "debug_api.h"
+
+/*
+ * Переводит двоичный лог (debug_binary_start) в текст.
+ *
+ * debug_decode [-t] file
+ *   -t  выводить время каждого события
+ */
+int main(int argc, char** argv)
+{
+    int with_time = 0;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0) with_time = 1;
+        else path = argv[i];
+    }
+    if (!path)
+    {
+        fprintf(stderr, "usage: %s [-t] file\n", argv[0]);
+        return 2;
+    }
+    if (debug_binary_decode(path, stdout, with_time) < 0)
+    {
+        fprintf(stderr, "%s: bad or truncated binary log\n", path);
+        return 1;
+    }
+    return 0;
+}
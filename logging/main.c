@@ -1,13 +1,169 @@
 #include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
 
 #include "debug_api.h"
 
+static void* worker(void* arg)
+{
+    int id = *(int*)arg;
+    for (int i = 0; i < 1000; i++)
+    {
+        __debug_print(1, __FILE__, __LINE__, "thread %d: message %d\n", id, i);
+    }
+    return NULL;
+}
+
+static void* sync_worker(void* arg)
+{
+    int id = *(int*)arg;
+    for (int i = 0; i < 50; i++)
+    {
+        __debug_print(1, __FILE__, __LINE__, "sync thread %d: message %d\n", id, i);
+    }
+    return NULL;
+}
+
+static void run_threads(void* (*fn)(void*))
+{
+    pthread_t threads[4];
+    int ids[4];
+    for (int i = 0; i < 4; i++)
+    {
+        ids[i] = i;
+        pthread_create(&threads[i], NULL, fn, &ids[i]);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/*
+ * Двоичный режим: пишем события и сравниваем результат декодера с тем, что
+ * выдал бы printf.
+ */
+static int binary_round_trip(void)
+{
+    static char expected[4096];
+    static char decoded[4096];
+    size_t used = 0, size;
+    const char* name = "city";
+    long long big = -1234567890123LL;
+    size_t count = 42;
+    ptrdiff_t diff = -7;
+    FILE* out;
+
+    if (debug_binary_start("debug_binary.log") != 0) return 0;
+
+#define CHECK_PRINT(source, ...) \
+    do { \
+        used += snprintf(expected + used, sizeof(expected) - used, __VA_ARGS__); \
+        if (source) used += snprintf(expected + used, sizeof(expected) - used, \
+                                     "\t\t\t%s (%d)\r\n", __FILE__, __LINE__); \
+        set_need_source(source); \
+        __debug_print(1, __FILE__, __LINE__, __VA_ARGS__); \
+    } while (0)
+
+    CHECK_PRINT(0, "plain text, 100%% literal\n");
+    CHECK_PRINT(1, "int %d, unsigned %u, hex %#x, char '%c'\n", -5, 7u, 255, 'z');
+    CHECK_PRINT(0, "long long %lld, size_t %zu, ptrdiff_t %td, short %hd\n", big, count, diff, (short)3);
+    CHECK_PRINT(1, "double %.3f, %e, %g, long double %Lf\n", 3.14159, 2.5e-10, 100.0, (long double)1.5);
+    CHECK_PRINT(0, "string '%s', width '%*s', precision '%.*s', '%-6s|'\n", name, 8, name, 2, name, "ab");
+    CHECK_PRINT(0, "%s and %5.1f%% done\n", "", 99.5);
+#undef CHECK_PRINT
+
+    debug_binary_stop();
+    set_need_source(0);
+
+    out = tmpfile();
+    if (!out) return 0;
+    if (debug_binary_decode("debug_binary.log", out, 0) != 6)
+    {
+        fclose(out);
+        return 0;
+    }
+    rewind(out);
+    size = fread(decoded, 1, sizeof(decoded), out);
+    fclose(out);
+    return size == used && memcmp(decoded, expected, used) == 0;
+}
+
+/*
+ * Испорченный двоичный лог: длина строки больше допустимой и файл,
+ * обрезанный на каждом байте. Декодер должен вернуть -1, а не упасть.
+ */
+static int binary_malformed(void)
+{
+    static const char marker[] = "malformed marker";
+    static char data[4096];
+    FILE* f;
+    FILE* out;
+    size_t size, i;
+    int ok = 1;
+
+    if (debug_binary_start("debug_binary.log") != 0) return 0;
+    __debug_print(1, __FILE__, __LINE__, "value %d, text %s\n", 42, marker);
+    debug_binary_stop();
+
+    f = fopen("debug_binary.log", "rb");
+    if (!f) return 0;
+    size = fread(data, 1, sizeof(data), f);
+    fclose(f);
+    out = fopen("/dev/null", "w");
+    if (!out) return 0;
+
+    for (i = 0; i < size; i++)
+    {
+        f = fopen("debug_binary_bad.log", "wb");
+        if (!f) break;
+        fwrite(data, 1, i, f);
+        fclose(f);
+        if (debug_binary_decode("debug_binary_bad.log", out, 1) > 0) ok = 0;
+    }
+
+    /*
+     * Событие: ..., размер аргументов (4 байта), int (4 байта), длина строки
+     * (2 байта), строка. Ставим длину 0xFFFF, исправляем размер аргументов
+     * и дописываем строку до конца файла, чтобы все остальное было целым.
+     */
+    for (i = 10; i + sizeof(marker) - 1 <= size; i++)
+    {
+        if (memcmp(data + i, marker, sizeof(marker) - 1) == 0)
+        {
+            unsigned int args_size = 4 + 2 + 0xFFFF;
+            unsigned short len = 0xFFFF;
+            static const char fill[0xFFFF];
+            memcpy(data + i - 10, &args_size, 4);
+            memcpy(data + i - 2, &len, 2);
+            f = fopen("debug_binary_bad.log", "wb");
+            if (!f) break;
+            fwrite(data, 1, i, f);
+            fwrite(fill, 1, sizeof(fill), f);
+            fclose(f);
+            if (debug_binary_decode("debug_binary_bad.log", out, 1) != -1) ok = 0;
+            break;
+        }
+    }
+    if (i + sizeof(marker) - 1 > size) ok = 0;
+    fclose(out);
+    remove("debug_binary_bad.log");
+    return ok;
+}
+
 int main(int argc, char** argv)
 {
     int l1=1, l2=2, l3=3;
 
 	fprintf(stderr, "start\r\n");
 
+    /* вид блокировки: main [mutex|adaptive|none] */
+    if (argc > 1)
+    {
+        if (strcmp(argv[1], "adaptive") == 0) debug_set_lock_kind(DEBUG_LOCK_ADAPTIVE);
+        else if (strcmp(argv[1], "none") == 0) debug_set_lock_kind(DEBUG_LOCK_NONE);
+    }
     allocate_mutex();
     
     //add_debug_level(1);
@@ -24,6 +180,36 @@ int main(int argc, char** argv)
 	__debug_print(2, __FILE__, __LINE__, "using level 2\n");
 	__debug_print(1, __FILE__, __LINE__, "using level %d, but not level %d neither %d\r\n", l1, l2, l3); 
 
+    /* аргументы выключенного уровня не вычисляются */
+    DEBUG_PRINT(1, "DEBUG_PRINT: level %d\n", l1++);
+    DEBUG_PRINT(2, "DEBUG_PRINT: level %d\n", l2++);
+    add_debug_level(2);
+    remove_debug_level(2);
+    fprintf(stderr, "l1=%d l2=%d\r\n", l1, l2);
+
+    set_need_source(0);
+
+    /* синхронный режим: 4 потока борются за блокировку */
+    {
+        debug_lock_stats st;
+        run_threads(sync_worker);
+        debug_lock_stats_get(&st);
+        fprintf(stderr, "lock: %llu acquisitions, %llu contended, %llu ns waiting\r\n",
+                st.acquisitions, st.contended, st.wait_ns);
+    }
+
+    /* асинхронный режим: 4 потока пишут в лог одновременно */
+    if (debug_async_start("debug_async.log", 1024, DEBUG_OVERFLOW_BLOCK) == 0)
+    {
+        run_threads(worker);
+        debug_async_flush();
+        fprintf(stderr, "async: dropped %lu messages, see debug_async.log\r\n", debug_async_dropped());
+        debug_async_stop();
+    }
+
+    fprintf(stderr, "binary round trip: %s\r\n", binary_round_trip() ? "OK" : "FAILED");
+    fprintf(stderr, "binary malformed: %s\r\n", binary_malformed() ? "OK" : "FAILED");
+
 	fprintf(stderr, "end\r\n");
 
     return 0;
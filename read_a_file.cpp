@@ -1,21 +1,36 @@
+#include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <iterator>
 #include <string>
 #include <sstream>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cputime.h"
+#include "chunked_reader.h"
 
 
 using namespace std;
 
-void readFile1(const char *fileName)
+size_t readFile1(const char *fileName)
 {
     std::ifstream ifs(fileName, std::ios::binary);
     std::string s;
     copy(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>(), back_inserter(s));
 
-    std::cout << " " << s.length() << " ";
+    return s.length();
 }
 
-void readFile2(const char *fileName)
+size_t readFile2(const char *fileName)
 {
     std::ifstream file(fileName, std::ios::binary);
     std::string str;
@@ -25,10 +40,10 @@ void readFile2(const char *fileName)
         istream_iterator<char>(), 
         insert_iterator<string>(str,str.begin()));
 
-    std::cout << " " << str.length() << " ";
+    return str.length();
 }
 
-void readFile3(const char *fileName)
+size_t readFile3(const char *fileName)
 {
     std::ifstream file(fileName, std::ios::binary);
     string str;
@@ -39,19 +54,19 @@ void readFile3(const char *fileName)
     str.resize( len);
     file.read( (char*)str.data(), len); 
 
-    std::cout << " " << str.length() << " ";
+    return str.length();
 }
 
-void readFile4(const char *fileName)
+size_t readFile4(const char *fileName)
 {
     string s;
     ifstream inp(fileName, std::ios::binary);
     getline(inp, s, '\0');
 
-    std::cout << " " << s.length() << " ";
+    return s.length();
 }
 
-void readFile5(const char *fileName)
+size_t readFile5(const char *fileName)
 {
     string s;
     ifstream is(fileName, std::ios::binary);
@@ -70,10 +85,10 @@ void readFile5(const char *fileName)
         s.append(1, c);
     }
 
-    std::cout << " " << s.length() << " ";
+    return s.length();
 }
 
-void readFile6(const char *fileName)
+size_t readFile6(const char *fileName)
 {
     typedef std::istream_iterator<char> IIC;
 
@@ -87,11 +102,11 @@ void readFile6(const char *fileName)
     str_file.reserve(size);
     std::copy(IIC(file), IIC(), std::back_inserter(str_file));
 
-    std::cout << " " << str_file.length() << " ";
+    return str_file.length();
 
 }
 
-void readFile7(const char *fileName)
+size_t readFile7(const char *fileName)
 {
     std::ifstream in(fileName, std::ios::binary);
     ostringstream out;           
@@ -100,45 +115,327 @@ void readFile7(const char *fileName)
     string s;
     out.str().swap(s); 
 
-    std::cout << " " << s.length() << " ";
+    return s.length();
+}
+
+size_t readFile8(const char *fileName)
+{
+    // zero-copy: the file is mapped and read through the page cache directly
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+    size_t len = st.st_size;
+
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return 0;
+    madvise(map, len, MADV_SEQUENTIAL);
+    madvise(map, len, MADV_WILLNEED);
+
+    // touch every page, otherwise nothing is actually read
+    const char *data = static_cast<const char*>(map);
+    const size_t page = sysconf(_SC_PAGESIZE);
+    unsigned char sum = 0;
+    for (size_t off = 0; off < len; off += page)
+        sum += data[off];
+    volatile unsigned char sink = sum;
+    (void)sink;
+
+    munmap(map, len);
+
+    return len;
+}
+
+size_t readFile9(const char *fileName)
+{
+    // one aligned buffer, allocated once and reused by every call
+    static const size_t alignment = 4096;
+    static char *buffer = NULL;
+    static size_t capacity = 0;
+
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return 0;
+    }
+    size_t need = (st.st_size + alignment - 1) / alignment * alignment;
+    if (need > capacity)
+    {
+        free(buffer);
+        if (posix_memalign((void**)&buffer, alignment, need) != 0)
+        {
+            buffer = NULL;
+            capacity = 0;
+            close(fd);
+            return 0;
+        }
+        capacity = need;
+    }
+
+    size_t len = 0;
+    for (;;)
+    {
+        ssize_t n = pread(fd, buffer + len, capacity - len, len);
+        if (n <= 0)
+            break;
+        len += n;
+        if (len == capacity)
+            break;
+    }
+    close(fd);
+
+    return len;
 }
 
-typedef void (*PF)(const char*);
+// asynchronous chunked reads, the consumer touches every page of a chunk
+static size_t readChunked(const char *fileName, ChunkedReader::Backend backend)
+{
+    static ChunkedReader uring(1 << 20, 8, ChunkedReader::eURING);
+    static ChunkedReader threads(1 << 20, 8, ChunkedReader::eTHREADS);
+    ChunkedReader &reader = (backend == ChunkedReader::eTHREADS) ? threads : uring;
+    unsigned char sum = 0;
+    uint64_t len = reader.read(fileName, [&sum](const char *data, size_t size, uint64_t) {
+        for (size_t off = 0; off < size; off += 4096)
+            sum += data[off];
+    });
+    volatile unsigned char sink = sum;
+    (void)sink;
+    if (reader.lastError())
+        std::cerr << fileName << ": " << strerror(reader.lastError()) << std::endl;
+    return len;
+}
+
+size_t readFile10(const char *fileName)
+{
+    return readChunked(fileName, ChunkedReader::eURING);
+}
+
+size_t readFile11(const char *fileName)
+{
+    return readChunked(fileName, ChunkedReader::eTHREADS);
+}
+
+typedef size_t (*PF)(const char*);
+
+struct Reader
+{
+    const char *name;
+    PF pf;
+};
+
+// wall and CPU time of every repetition of one reader on one file
+struct Samples
+{
+    std::vector<double> wall;
+    std::vector<double> cpu;
+    size_t bytes;
+};
 
 class FReadFile
 {
 public:
-    FReadFile(const char *fileName)
-        :    fileName(fileName)
+    FReadFile(const char *fileName, bool dropCache)
+        :    fileName(fileName), dropCache(dropCache)
     {
     }
 
-    void operator()(PF pf) const
+    // runs the reader once and returns the number of bytes it read
+    size_t operator()(PF pf, Samples &samples) const
     {
-        pf(fileName);
+        if (dropCache)
+            evict();
+
+        double cpu0 = getCPUTime();
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        size_t bytes = pf(fileName);
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        double cpu1 = getCPUTime();
+
+        samples.wall.push_back(std::chrono::duration<double>(t1 - t0).count());
+        samples.cpu.push_back(cpu1 - cpu0);
+        samples.bytes = bytes;
+        return bytes;
     }
 
 private:
+    // asks the kernel to drop the cached pages of the file, so the next
+    // read goes to the disk
+    void evict() const
+    {
+        int fd = open(fileName, O_RDONLY);
+        if (fd < 0)
+            return;
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+
     const char *fileName;
+    bool dropCache;
 };
 
-int main() 
-{ 
-    
+// text file of the given size: lines of random lowercase words
+static bool generateFile(const std::string &fileName, size_t size)
+{
+    FILE *f = fopen(fileName.c_str(), "wb");
+    if (!f)
+        return false;
 
-    const size_t readersCount = 7;
-    PF readers[readersCount] = {
-        readFile1, readFile2, readFile3, 
-        readFile4, readFile5, readFile6, 
-        readFile7
+    std::string line;
+    unsigned seed = 12345;
+    size_t written = 0;
+    while (written < size)
+    {
+        line.clear();
+        for (int w = 0; w < 10; ++w)
+        {
+            seed = seed * 1103515245 + 12345;
+            size_t len = 2 + (seed >> 16) % 9;
+            for (size_t i = 0; i < len; ++i)
+            {
+                seed = seed * 1103515245 + 12345;
+                line += char('a' + (seed >> 16) % 26);
+            }
+            line += (w == 9) ? '\n' : ' ';
+        }
+        size_t n = std::min(line.size(), size - written);
+        fwrite(line.data(), 1, n, f);
+        written += n;
+    }
+    fclose(f);
+    return true;
+}
+
+static double percentile(std::vector<double> v, double p)
+{
+    std::sort(v.begin(), v.end());
+    size_t idx = (size_t)(p * (v.size() - 1) + 0.5);
+    return v[idx];
+}
+
+// "64", "64K", "64M", "1G" -> bytes
+static size_t parseSize(const char *s)
+{
+    char *end;
+    double v = strtod(s, &end);
+    switch (*end)
+    {
+    case 'k': case 'K': v *= 1024; break;
+    case 'm': case 'M': v *= 1024 * 1024; break;
+    case 'g': case 'G': v *= 1024.0 * 1024 * 1024; break;
+    }
+    return (size_t)v;
+}
+
+static void usage(const char *prog)
+{
+    std::cerr << "usage: " << prog << " [-r repetitions] [-c] [-k] [-d dir] [size ...]\n"
+              << "  -r N    runs of every reader on every file (default 10)\n"
+              << "  -c      drop the page cache of the file before every run\n"
+              << "  -k      keep the generated files\n"
+              << "  -d DIR  where to create the test files (default /tmp)\n"
+              << "  size    test file sizes, e.g. 1M 64M 1G (default 1M 16M)\n";
+}
+
+int main(int argc, char *argv[])
+{
+    size_t repetitions = 10;
+    bool dropCache = false;
+    bool keepFiles = false;
+    std::string dir = "/tmp";
+    std::vector<size_t> sizes;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "-r" && i + 1 < argc)
+            repetitions = std::max(1, atoi(argv[++i]));
+        else if (arg == "-c")
+            dropCache = true;
+        else if (arg == "-k")
+            keepFiles = true;
+        else if (arg == "-d" && i + 1 < argc)
+            dir = argv[++i];
+        else if (arg[0] != '-' && parseSize(argv[i]) > 0)
+            sizes.push_back(parseSize(argv[i]));
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (sizes.empty())
+    {
+        sizes.push_back(1 << 20);
+        sizes.push_back(16 << 20);
+    }
+
+    const size_t readersCount = 11;
+    Reader readers[readersCount] = {
+        { "ifstream istreambuf_iterator", readFile1 },
+        { "ifstream istream_iterator",    readFile2 },
+        { "ifstream read",                readFile3 },
+        { "getline",                      readFile4 },
+        { "get() per char",               readFile5 },
+        { "istream_iterator reserved",    readFile6 },
+        { "rdbuf to ostringstream",       readFile7 },
+        { "mmap",                         readFile8 },
+        { "pread aligned",                readFile9 },
+        { "chunked io_uring",             readFile10 },
+        { "chunked pread threads",        readFile11 }
     };
-    
-    FReadFile func("c:\\temp\\prof\\test.txt");
 
-    for(int i = 0; i < 10; ++i)
+    printf("%s cache, %zu repetitions\n", dropCache ? "cold" : "warm", repetitions);
+    printf("%-30s %10s %10s %10s %10s %10s %10s\n",
+           "reader", "size", "min ms", "median ms", "p99 ms", "MB/s", "cpu ms");
+
+    for (size_t s = 0; s < sizes.size(); ++s)
     {
-        std::for_each(readers, readers + readersCount, func);
-        std::cout << i << "\n";
-    }    
+        std::string fileName = dir + "/read_a_file_" + std::to_string(sizes[s]) + ".txt";
+        if (!generateFile(fileName, sizes[s]))
+        {
+            std::cerr << "cannot create " << fileName << "\n";
+            return 1;
+        }
 
+        FReadFile func(fileName.c_str(), dropCache);
+        for (size_t r = 0; r < readersCount; ++r)
+        {
+            Samples samples;
+            func(readers[r].pf, samples); // warm-up, not counted
+            samples.wall.clear();
+            samples.cpu.clear();
+            for (size_t i = 0; i < repetitions; ++i)
+                func(readers[r].pf, samples);
+
+            double median = percentile(samples.wall, 0.5);
+            double cpu = 0;
+            for (size_t i = 0; i < samples.cpu.size(); ++i)
+                cpu += samples.cpu[i];
+            cpu /= samples.cpu.size();
+
+            printf("%-30s %10zu %10.3f %10.3f %10.3f %10.1f %10.3f%s\n",
+                   readers[r].name, sizes[s],
+                   percentile(samples.wall, 0.0) * 1e3, median * 1e3,
+                   percentile(samples.wall, 0.99) * 1e3,
+                   sizes[s] / median / (1024 * 1024), cpu * 1e3,
+                   samples.bytes == sizes[s] ? "" : "  (short read)");
+        }
+
+        if (!keepFiles)
+            unlink(fileName.c_str());
+    }
 }
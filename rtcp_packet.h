@@ -0,0 +1,352 @@
+#ifndef RTCP_PACKET_H
+#define RTCP_PACKET_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * RTCP (RFC 3550) compound packet parsing.
+ *
+ * The views below do not copy anything: they keep a pointer into the
+ * received buffer and decode network-order fields on access. The buffer
+ * must outlive the views. RTCPCompoundParser validates the lengths and
+ * counts of every packet before handing it out, so the accessors of a view
+ * obtained from the parser never read past the packet.
+ */
+
+typedef uint32_t u_int32;
+
+/**
+ * @brief Report block in host order. Bit-fields are not a wire layout, use
+ * RTCPReportBlockView to read a received block.
+ */
+struct RTCPReceiverBlock
+{
+	u_int32 ssrc;
+	u_int32 fractionLost	: 8;
+	u_int32 cummulativeLost	: 24;
+	u_int32 highestSeq;
+	u_int32 jitter;
+	u_int32 lastTimeStamp;
+	u_int32 delay;
+};
+
+enum RTCPPacketType {
+    eRTCP_SR   = 200,
+    eRTCP_RR   = 201,
+    eRTCP_SDES = 202,
+    eRTCP_BYE  = 203,
+    eRTCP_APP  = 204
+};
+
+enum RTCPParseStatus {
+    eRTCP_OK = 0,
+    eRTCP_END,              // no more packets
+    eRTCP_TRUNCATED,        // packet is longer than the rest of the buffer
+    eRTCP_BAD_VERSION,      // version is not 2
+    eRTCP_BAD_PADDING,      // padding on a non-last packet or too large
+    eRTCP_BAD_COUNT,        // RC/SC does not fit the packet length
+    eRTCP_BAD_SDES,         // malformed SDES chunk
+    eRTCP_BAD_FIRST_PACKET  // compound packet does not start with SR/RR
+};
+
+inline uint16_t rtcp_load16(const uint8_t* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+inline uint32_t rtcp_load32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/**
+ * @brief Report block (24 bytes) of SR/RR packets.
+ */
+class RTCPReportBlockView {
+    const uint8_t* m_p;
+public:
+    static const size_t SIZE = 24;
+
+    explicit RTCPReportBlockView(const uint8_t* p) : m_p(p) {}
+
+    const uint8_t* data()          const { return m_p; }
+    uint32_t       ssrc()          const { return rtcp_load32(m_p); }
+    uint8_t        fraction_lost() const { return m_p[4]; }
+    uint32_t       highest_seq()   const { return rtcp_load32(m_p + 8); }
+    uint32_t       jitter()        const { return rtcp_load32(m_p + 12); }
+    uint32_t       lsr()           const { return rtcp_load32(m_p + 16); }
+    uint32_t       dlsr()          const { return rtcp_load32(m_p + 20); }
+
+    /**
+     * @brief Cumulative number of packets lost, a signed 24-bit value.
+     */
+    int32_t cumulative_lost() const {
+        int32_t v = (int32_t)(rtcp_load32(m_p + 4) & 0x00FFFFFF);
+        return (v & 0x00800000) ? v - 0x01000000 : v;
+    }
+
+    RTCPReceiverBlock to_host() const {
+        RTCPReceiverBlock block;
+        block.ssrc            = ssrc();
+        block.fractionLost    = fraction_lost();
+        block.cummulativeLost = rtcp_load32(m_p + 4) & 0x00FFFFFF;
+        block.highestSeq      = highest_seq();
+        block.jitter          = jitter();
+        block.lastTimeStamp   = lsr();
+        block.delay           = dlsr();
+        return block;
+    }
+};
+
+/**
+ * @brief Single RTCP packet of a compound packet.
+ */
+class RTCPPacketView {
+protected:
+    const uint8_t* m_p;
+    size_t m_nSize;     // whole packet, header and padding included
+    size_t m_nPayload;  // bytes after the header, padding excluded
+public:
+    static const size_t HEADER_SIZE = 4;
+
+    RTCPPacketView() : m_p(NULL), m_nSize(0), m_nPayload(0) {}
+    RTCPPacketView(const uint8_t* p, size_t size, size_t payload)
+    : m_p(p), m_nSize(size), m_nPayload(payload) {}
+
+    unsigned       version()      const { return m_p[0] >> 6; }
+    bool           padding()      const { return (m_p[0] >> 5) & 0x1; }
+    unsigned       count()        const { return m_p[0] & 0x1F; }
+    unsigned       type()         const { return m_p[1]; }
+    const uint8_t* data()         const { return m_p; }
+    size_t         size()         const { return m_nSize; }
+    const uint8_t* payload()      const { return m_p + HEADER_SIZE; }
+    size_t         payload_size() const { return m_nPayload; }
+};
+
+/**
+ * @brief Sender report: sender info followed by count() report blocks.
+ */
+class RTCPSenderReportView : public RTCPPacketView {
+public:
+    static const size_t MIN_SIZE = 28;
+
+    explicit RTCPSenderReportView(const RTCPPacketView& packet) : RTCPPacketView(packet) {}
+
+    uint32_t ssrc()          const { return rtcp_load32(m_p + 4); }
+    uint32_t ntp_msw()       const { return rtcp_load32(m_p + 8); }
+    uint32_t ntp_lsw()       const { return rtcp_load32(m_p + 12); }
+    uint64_t ntp()           const { return ((uint64_t)ntp_msw() << 32) | ntp_lsw(); }
+    uint32_t rtp_timestamp() const { return rtcp_load32(m_p + 16); }
+    uint32_t packet_count()  const { return rtcp_load32(m_p + 20); }
+    uint32_t octet_count()   const { return rtcp_load32(m_p + 24); }
+
+    RTCPReportBlockView report(size_t i) const {
+        return RTCPReportBlockView(m_p + MIN_SIZE + i * RTCPReportBlockView::SIZE);
+    }
+};
+
+/**
+ * @brief Receiver report: reporter SSRC followed by count() report blocks.
+ */
+class RTCPReceiverReportView : public RTCPPacketView {
+public:
+    static const size_t MIN_SIZE = 8;
+
+    explicit RTCPReceiverReportView(const RTCPPacketView& packet) : RTCPPacketView(packet) {}
+
+    uint32_t ssrc() const { return rtcp_load32(m_p + 4); }
+
+    RTCPReportBlockView report(size_t i) const {
+        return RTCPReportBlockView(m_p + MIN_SIZE + i * RTCPReportBlockView::SIZE);
+    }
+};
+
+/**
+ * @brief SDES item. The text is not null-terminated.
+ */
+struct RTCPSdesItem {
+    uint8_t     type;
+    uint8_t     length;
+    const char* text;
+};
+
+/**
+ * @brief Source description: count() chunks of SSRC/CSRC and items.
+ */
+class RTCPSdesView : public RTCPPacketView {
+public:
+    explicit RTCPSdesView(const RTCPPacketView& packet) : RTCPPacketView(packet) {}
+
+    /**
+     * @brief Calls f(uint32_t ssrc, const RTCPSdesItem& item) for every item.
+     *
+     * @return false if the chunks are malformed. The parser checks this
+     * already, so it only fails for views built by hand.
+     */
+    template <class F>
+    bool for_each_item(F f) const {
+        const uint8_t* p = payload();
+        const uint8_t* end = p + payload_size();
+        for (unsigned chunk = 0; chunk < count(); chunk++) {
+            if (end - p < 4) return false;
+            uint32_t ssrc = rtcp_load32(p);
+            p += 4;
+            for (;;) {
+                if (p >= end) return false;
+                if (*p == 0) {
+                    // null item, then padding up to a 32-bit boundary
+                    p += 4 - ((p - m_p) & 0x3);
+                    break;
+                }
+                if (end - p < 2 || end - p - 2 < p[1]) return false;
+                RTCPSdesItem item = { p[0], p[1], reinterpret_cast<const char*>(p + 2) };
+                f(ssrc, item);
+                p += 2 + item.length;
+            }
+            if (p > end) return false;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Goodbye: count() SSRC/CSRC identifiers and an optional reason.
+ */
+class RTCPByeView : public RTCPPacketView {
+public:
+    explicit RTCPByeView(const RTCPPacketView& packet) : RTCPPacketView(packet) {}
+
+    uint32_t ssrc(size_t i) const { return rtcp_load32(payload() + i * 4); }
+
+    size_t reason_size() const {
+        size_t offset = count() * 4;
+        return (offset < payload_size()) ? payload()[offset] : 0;
+    }
+
+    const char* reason() const {
+        return reinterpret_cast<const char*>(payload() + count() * 4 + 1);
+    }
+};
+
+/**
+ * @brief Application-defined packet. count() holds the subtype.
+ */
+class RTCPAppView : public RTCPPacketView {
+public:
+    static const size_t MIN_SIZE = 12;
+
+    explicit RTCPAppView(const RTCPPacketView& packet) : RTCPPacketView(packet) {}
+
+    unsigned       subtype()        const { return count(); }
+    uint32_t       ssrc()           const { return rtcp_load32(m_p + 4); }
+    const char*    name()           const { return reinterpret_cast<const char*>(m_p + 8); }
+    const uint8_t* app_data()       const { return m_p + MIN_SIZE; }
+    size_t         app_data_size()  const { return HEADER_SIZE + m_nPayload - MIN_SIZE; }
+};
+
+/**
+ * @brief Walks the packets of a compound packet.
+ *
+ * @code
+ * RTCPCompoundParser parser(buf, len);
+ * RTCPPacketView packet;
+ * while (parser.next(packet) == eRTCP_OK) {
+ *     if (packet.type() == eRTCP_RR) {
+ *         RTCPReceiverReportView rr(packet);
+ *         ...
+ *     }
+ * }
+ * if (parser.status() != eRTCP_END) { ...malformed... }
+ * @endcode
+ */
+class RTCPCompoundParser {
+    const uint8_t* m_pData;
+    size_t m_nSize;
+    size_t m_nOffset;
+    RTCPParseStatus m_status;
+    bool m_bStrict;
+
+    RTCPParseStatus fail(RTCPParseStatus status) {
+        m_status = status;
+        return status;
+    }
+
+    static bool check_sdes(const RTCPPacketView& packet) {
+        return RTCPSdesView(packet).for_each_item([](uint32_t, const RTCPSdesItem&) {});
+    }
+
+public:
+    /**
+     * @param data Received buffer
+     * @param size Size of the buffer in bytes
+     * @param strict Require the compound packet to start with SR or RR
+     */
+    RTCPCompoundParser(const uint8_t* data, size_t size, bool strict = true)
+    : m_pData(data), m_nSize(size), m_nOffset(0), m_status(eRTCP_OK), m_bStrict(strict) {}
+
+    RTCPParseStatus status() const { return m_status; }
+    size_t          offset() const { return m_nOffset; }
+
+    /**
+     * @brief Validates the next packet and returns a view of it.
+     *
+     * @return eRTCP_OK and the packet, eRTCP_END when the buffer is consumed
+     * or an error code. Errors are sticky.
+     */
+    RTCPParseStatus next(RTCPPacketView& packet) {
+        if (m_status != eRTCP_OK) {
+            return m_status;
+        }
+        size_t rest = m_nSize - m_nOffset;
+        if (rest == 0) {
+            return fail(eRTCP_END);
+        }
+        if (rest < RTCPPacketView::HEADER_SIZE) {
+            return fail(eRTCP_TRUNCATED);
+        }
+        const uint8_t* p = m_pData + m_nOffset;
+        if ((p[0] >> 6) != 2) {
+            return fail(eRTCP_BAD_VERSION);
+        }
+        size_t size = ((size_t)rtcp_load16(p + 2) + 1) * 4;
+        if (size > rest) {
+            return fail(eRTCP_TRUNCATED);
+        }
+        size_t payload = size - RTCPPacketView::HEADER_SIZE;
+        if ((p[0] >> 5) & 0x1) {
+            // only the last packet of a compound packet may be padded
+            if (size != rest || p[size - 1] == 0 || p[size - 1] > payload) {
+                return fail(eRTCP_BAD_PADDING);
+            }
+            payload -= p[size - 1];
+        }
+        unsigned count = p[0] & 0x1F;
+        unsigned type = p[1];
+        if (m_bStrict && m_nOffset == 0 && type != eRTCP_SR && type != eRTCP_RR) {
+            return fail(eRTCP_BAD_FIRST_PACKET);
+        }
+        size_t need = 0;
+        switch (type) {
+            case eRTCP_SR:  need = RTCPSenderReportView::MIN_SIZE + count * RTCPReportBlockView::SIZE; break;
+            case eRTCP_RR:  need = RTCPReceiverReportView::MIN_SIZE + count * RTCPReportBlockView::SIZE; break;
+            case eRTCP_BYE: need = RTCPPacketView::HEADER_SIZE + count * 4; break;
+            case eRTCP_APP: need = RTCPAppView::MIN_SIZE; break;
+        }
+        if (need > RTCPPacketView::HEADER_SIZE + payload) {
+            return fail(eRTCP_BAD_COUNT);
+        }
+        packet = RTCPPacketView(p, size, payload);
+        if (type == eRTCP_SDES && !check_sdes(packet)) {
+            return fail(eRTCP_BAD_SDES);
+        }
+        if (type == eRTCP_BYE) {
+            RTCPByeView bye(packet);
+            if (bye.reason_size() && count * 4 + 1 + bye.reason_size() > payload) {
+                return fail(eRTCP_BAD_COUNT);
+            }
+        }
+        m_nOffset += size;
+        return eRTCP_OK;
+    }
+};
+
+#endif
@@ -3,114 +3,346 @@
 #include <vector>
 #include <algorithm>
 #include <cassert>
-#include <sstream>
-#include <iostream>
-#include <iomanip>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+
+#include "c++11/bitdump.h"
+#include "rtcp_packet.h"
 
-class Cbitset {
-protected:
-    size_t m_nSize;
-    std::vector<uint8_t> m_Data;
+/*
+ * Output buffer owned by the caller. It grows to the working size once and
+ * is reused afterwards. With a FILE the data is written in large blocks:
+ * appends flush automatically when the buffer reaches flushSize. Without a
+ * FILE the buffer only accumulates, use data()/size() to take the result.
+ */
+class RTCPOutputBuffer {
+    std::vector<char> m_Data;
+    size_t m_nUsed;
+    size_t m_nFlushed;      // bytes already written to m_pOut
+    size_t m_nFlushSize;
+    FILE* m_pOut;
 public:
-    virtual ~Cbitset() = default;
-    Cbitset(Cbitset &&) = default;
-    Cbitset(const Cbitset &) = default;
-    explicit Cbitset(size_t nBits, uint64_t value)
-    : m_nSize(0)
-    {
-        size_t nBytes = resize(nBits); // m_nSize updated
-        std::fill_n(m_Data.begin(), m_Data.size(), 0);
-        if (m_nSize < sizeof(uint64_t)) {
-            assert(nBytes < 3);
-            uint64_t maskedValue = value & ((1 << (m_nSize + 1)) - 1);
-            for (size_t i = 0; i < m_Data.size(); i++) {
-                m_Data[i] = (maskedValue >> (i * 8)) & 0xff;
-            }
-        } else {
-            for (size_t i = 0; i < sizeof(uint64_t); i++) {
-                m_Data[i] = (value >> (i * 8)) & 0xff;
-            }
+    explicit RTCPOutputBuffer(FILE* out = stdout, size_t flushSize = 64 * 1024)
+    : m_Data(flushSize + 1024), m_nUsed(0), m_nFlushed(0), m_nFlushSize(flushSize), m_pOut(out) {}
+    ~RTCPOutputBuffer() { flush(); }
+
+    const char* data() const { return m_Data.data(); }
+    size_t      size() const { return m_nUsed; }
+    /** Bytes formatted so far, flushed or still in the buffer */
+    size_t      written() const { return m_nFlushed + m_nUsed; }
+    void        clear()      { m_nUsed = 0; }
+
+    /**
+     * @brief Returns space for at least n characters at the end of the
+     * buffer. Finish the write with commit().
+     */
+    char* reserve(size_t n) {
+        if (m_pOut && m_nUsed + n > m_nFlushSize) {
+            flush();
+        }
+        if (m_nUsed + n > m_Data.size()) {
+            m_Data.resize(std::max(m_Data.size() * 2, m_nUsed + n));
+        }
+        return m_Data.data() + m_nUsed;
+    }
+
+    void commit(const char* end) { m_nUsed = end - m_Data.data(); }
+
+    void append(const char* s, size_t n) {
+        char* p = reserve(n);
+        std::memcpy(p, s, n);
+        commit(p + n);
+    }
+
+    void flush() {
+        if (m_pOut && m_nUsed) {
+            fwrite(m_Data.data(), 1, m_nUsed, m_pOut);
+            m_nFlushed += m_nUsed;
+            m_nUsed = 0;
+        }
+    }
+};
+
+enum RTCPPrintFormat {
+    eRTCP_PRINT_BINARY = 0, // one row per 32-bit word: offset, bits and hex
+    eRTCP_PRINT_HEX,        // one row per 32-bit word: offset and hex
+    eRTCP_PRINT_COMPACT,    // one line per block: name=value pairs
+    eRTCP_PRINT_JSON        // one JSON object per line
+};
+
+/*
+ * Formats report blocks straight into an RTCPOutputBuffer. Numbers are
+ * converted by hand and bit/hex digits come from the bitdump.h kernels, so
+ * there are no streams, temporary strings or allocations per block.
+ */
+class RTCPStreamPrinter {
+    RTCPOutputBuffer& m_Out;
+    RTCPPrintFormat m_eFormat;
+    bool m_bTitle;
+
+    static const size_t WORDS = RTCPReportBlockView::SIZE / 4;
+    static const size_t MAX_BLOCK_CHARS = 512;
+
+    static char* put_str(char* p, const char* s, size_t n) {
+        std::memcpy(p, s, n);
+        return p + n;
+    }
+
+    template <size_t N>
+    static char* put_lit(char* p, const char (&s)[N]) {
+        return put_str(p, s, N - 1);
+    }
+
+    static char* put_udec(char* p, uint32_t v) {
+        char tmp[10];
+        size_t n = 0;
+        do {
+            tmp[n++] = '0' + v % 10;
+            v /= 10;
+        } while (v);
+        while (n) {
+            *p++ = tmp[--n];
         }
+        return p;
     }
 
-    size_t         bits_num() const { return m_nSize; }
-    size_t         size()           { return m_Data.size(); }
-    const uint8_t* data()     const { return m_Data.data(); }
-    uint8_t*       data()           { return m_Data.data(); }
+    static char* put_dec(char* p, int32_t v) {
+        if (v < 0) {
+            *p++ = '-';
+            return put_udec(p, 0u - (uint32_t)v);
+        }
+        return put_udec(p, (uint32_t)v);
+    }
 
-    size_t resize(size_t nBits) {
-        m_nSize = nBits;
-        size_t nBytes;
-        if (m_nSize < 8) {
-            nBytes = 1;
-        } else {
-            nBytes = 1 + (m_nSize - 1) / 8;
+    static char* put_offset(char* p, size_t offset) {
+        // "%08zu: "
+        for (size_t i = 8; i-- > 0; offset /= 10) {
+            p[i] = '0' + offset % 10;
         }
-        m_Data.resize(nBytes);
-        return nBytes;
+        return put_lit(p + 8, ": ");
     }
 
-    bool operator[](size_t pos) const {
-        size_t byte = pos / 8, offset = pos % 8;
-        return (m_Data[byte] >> offset) & 0x1;
+    static char* put_hex(char* p, const uint8_t* bytes) {
+        return Toolkit::hex_to_chars(bytes, 4, put_lit(p, "0x"));
     }
 
-    std::string to_string(unsigned int blk = 4) const {
-        std::stringstream ss;
-        bool formatting = (blk > 0 && blk < m_nSize) ? true : false;
-        for (size_t i = 0; i < m_nSize; i++) {
-            ss << ((*this)[m_nSize - i - 1] ? "1" : "0");
-            if (formatting && !((i+1) % blk)) {
-                ss << " ";
+    char* rows(char* p, const uint8_t* bytes, bool bits) const {
+        if (m_bTitle) {
+            p = put_lit(p, "(RTCP) Receiver block ---------------------------\n");
+        }
+        for (size_t i = 0; i < WORDS; i++, bytes += 4) {
+            p = put_offset(p, i * 32);
+            if (bits) {
+                p = Toolkit::bits_to_chars(bytes, 4, p, 4);
+                *p++ = '(';
+                p = put_hex(p, bytes);
+                *p++ = ')';
+            } else {
+                p = put_hex(p, bytes);
             }
+            *p++ = '\n';
         }
-        return ss.str();
+        return p;
+    }
+
+    static char* compact(char* p, const RTCPReportBlockView& b) {
+        p = put_lit(p, "ssrc=");
+        p = put_hex(p, b.data());
+        p = put_lit(p, " fraction_lost=");
+        p = put_udec(p, b.fraction_lost());
+        p = put_lit(p, " cumulative_lost=");
+        p = put_dec(p, b.cumulative_lost());
+        p = put_lit(p, " highest_seq=");
+        p = put_udec(p, b.highest_seq());
+        p = put_lit(p, " jitter=");
+        p = put_udec(p, b.jitter());
+        p = put_lit(p, " lsr=");
+        p = put_hex(p, b.data() + 16);
+        p = put_lit(p, " dlsr=");
+        p = put_udec(p, b.dlsr());
+        *p++ = '\n';
+        return p;
     }
-};
 
-typedef unsigned long int u_int32;
-struct RTCPReceiverBlock
-{
-	u_int32 ssrc;
-	u_int32 fractionLost	: 8;
-	u_int32 cummulativeLost	: 24;
-	u_int32 highestSeq;
-	u_int32 jitter;
-	u_int32 lastTimeStamp;
-	u_int32 delay;
+    static char* json(char* p, const RTCPReportBlockView& b) {
+        p = put_lit(p, "{\"ssrc\":");
+        p = put_udec(p, b.ssrc());
+        p = put_lit(p, ",\"fraction_lost\":");
+        p = put_udec(p, b.fraction_lost());
+        p = put_lit(p, ",\"cumulative_lost\":");
+        p = put_dec(p, b.cumulative_lost());
+        p = put_lit(p, ",\"highest_seq\":");
+        p = put_udec(p, b.highest_seq());
+        p = put_lit(p, ",\"jitter\":");
+        p = put_udec(p, b.jitter());
+        p = put_lit(p, ",\"lsr\":");
+        p = put_udec(p, b.lsr());
+        p = put_lit(p, ",\"dlsr\":");
+        p = put_udec(p, b.dlsr());
+        p = put_lit(p, "}\n");
+        return p;
+    }
+
+public:
+    RTCPStreamPrinter(RTCPOutputBuffer& out, RTCPPrintFormat format = eRTCP_PRINT_BINARY, bool title = false)
+    : m_Out(out), m_eFormat(format), m_bTitle(title) {}
+
+    void print(const RTCPReportBlockView& block) {
+        char* p = m_Out.reserve(MAX_BLOCK_CHARS);
+        switch (m_eFormat) {
+            case eRTCP_PRINT_BINARY:  p = rows(p, block.data(), true); break;
+            case eRTCP_PRINT_HEX:     p = rows(p, block.data(), false); break;
+            case eRTCP_PRINT_COMPACT: p = compact(p, block); break;
+            case eRTCP_PRINT_JSON:    p = json(p, block); break;
+        }
+        m_Out.commit(p);
+    }
+
+    void print(const RTCPReceiverBlock& block) {
+        uint8_t wire[RTCPReportBlockView::SIZE];
+        const uint32_t words[WORDS] = {
+            block.ssrc,
+            ((uint32_t)(block.fractionLost & 0xFF) << 24) | ((uint32_t)block.cummulativeLost & 0x00FFFFFF),
+            block.highestSeq, block.jitter, block.lastTimeStamp, block.delay
+        };
+        for (size_t i = 0; i < WORDS; i++) {
+            wire[i * 4 + 0] = words[i] >> 24;
+            wire[i * 4 + 1] = (words[i] >> 16) & 0xff;
+            wire[i * 4 + 2] = (words[i] >> 8) & 0xff;
+            wire[i * 4 + 3] = words[i] & 0xff;
+        }
+        print(RTCPReportBlockView(wire));
+    }
 };
 
 std::string print(const RTCPReceiverBlock& block, bool title = false) {
-    size_t offset = 0;
-    std::stringstream ss;
-    size_t line = 0;
-    if (title)
-        ss << "(RTCP) Receiver block ---------------------------" << std::endl;
-    do {
-        ss << std::setw(8) << std::setfill('0') << offset << std::setw(0)  << ": ";
-        if (offset == 32) {
-            u_int32 merged_value = (((block.fractionLost & 0x000000FF) << 24) | (block.cummulativeLost & 0x00FFFFFF)) ;
-            ss << Cbitset(8, block.fractionLost).to_string() << Cbitset(24, block.cummulativeLost).to_string() 
-               << "(0x" << std::setw(8) << std::setfill('0') << std::hex << merged_value << ")" << std::dec;
-        } else {
-            switch (line)
-            {
-                case 0: ss << Cbitset(sizeof(u_int32)*8, block.ssrc).to_string() 
-                           << "(0x" << std::setw(8) << std::setfill('0') << std::hex << block.ssrc << std::setw(0) << ")" << std::dec; break;
-                case 2: ss << Cbitset(sizeof(u_int32)*8, block.highestSeq).to_string() 
-                           << "(0x" << std::setw(8) << std::setfill('0') << std::hex << block.highestSeq << std::setw(0) << ")" << std::dec; break;
-                case 3: ss << Cbitset(sizeof(u_int32)*8, block.jitter).to_string() 
-                           << "(0x" << std::setw(8) << std::setfill('0') << std::hex << block.jitter << std::setw(0) << ")" << std::dec; break;
-                case 4: ss << Cbitset(sizeof(u_int32)*8, block.lastTimeStamp).to_string() 
-                           << "(0x" << std::setw(8) << std::setfill('0') << std::hex << block.lastTimeStamp << std::setw(0) << ")" << std::dec; break;
-                case 5: ss << Cbitset(sizeof(u_int32)*8, block.delay).to_string()
-                           << "(0x" << std::setw(8) << std::setfill('0') <<  std::hex << block.delay << std::setw(0) << ")" << std::dec; break;
+    RTCPOutputBuffer out(NULL, 1024);
+    RTCPStreamPrinter(out, eRTCP_PRINT_BINARY, title).print(block);
+    return std::string(out.data(), out.size());
+}
+
+void put16(uint8_t* p, uint16_t v) { p[0] = v >> 8; p[1] = v & 0xff; }
+void put32(uint8_t* p, uint32_t v) { put16(p, v >> 16); put16(p + 2, v & 0xffff); }
+
+/*
+ * Builds a synthetic compound packet: SR with nBlocks report blocks,
+ * SDES with a CNAME item and BYE with a reason.
+ */
+size_t build_compound(uint8_t* buf, unsigned nBlocks, uint32_t seed) {
+    uint8_t* p = buf;
+    size_t len = RTCPSenderReportView::MIN_SIZE + nBlocks * RTCPReportBlockView::SIZE;
+    p[0] = 0x80 | nBlocks; p[1] = eRTCP_SR; put16(p + 2, len / 4 - 1);
+    put32(p + 4, seed);
+    put32(p + 8, 0xe1e2e3e4); put32(p + 12, 0x80000000 + seed);
+    put32(p + 16, seed * 160); put32(p + 20, seed); put32(p + 24, seed * 172);
+    for (unsigned i = 0; i < nBlocks; i++) {
+        uint8_t* b = p + RTCPSenderReportView::MIN_SIZE + i * RTCPReportBlockView::SIZE;
+        put32(b, seed + i + 1);
+        put32(b + 4, ((i * 7) << 24) | (seed + i));
+        put32(b + 8, 0x10000 + seed);
+        put32(b + 12, i * 3);
+        put32(b + 16, 0xe3e48000);
+        put32(b + 20, 0x00010000);
+    }
+    p += len;
+
+    const char cname[] = "user@host.example";
+    size_t item = 2 + sizeof(cname) - 1;
+    len = 4 + ((4 + item + 1 + 3) & ~(size_t)3);
+    p[0] = 0x81; p[1] = eRTCP_SDES; put16(p + 2, len / 4 - 1);
+    put32(p + 4, seed);
+    p[8] = 1; p[9] = sizeof(cname) - 1;
+    std::memcpy(p + 10, cname, sizeof(cname) - 1);
+    std::memset(p + 10 + sizeof(cname) - 1, 0, len - 10 - (sizeof(cname) - 1));
+    p += len;
+
+    const char reason[] = "bye";
+    len = 8 + 4;
+    p[0] = 0x81; p[1] = eRTCP_BYE; put16(p + 2, len / 4 - 1);
+    put32(p + 4, seed);
+    p[8] = sizeof(reason) - 1;
+    std::memcpy(p + 9, reason, sizeof(reason) - 1);
+    p += len;
+
+    return p - buf;
+}
+
+/*
+ * Decodes the same set of compound packets over and over and reports how
+ * many report blocks per second one core gets through.
+ */
+void bench_parser(size_t nPackets, size_t iterations) {
+    std::vector<uint8_t> buffer(nPackets * 512);
+    std::vector<size_t> sizes(nPackets);
+    size_t total = 0;
+    for (size_t i = 0; i < nPackets; i++) {
+        sizes[i] = build_compound(&buffer[total], 1 + i % 4, (uint32_t)i);
+        total += sizes[i];
+    }
+
+    size_t reports = 0, bad = 0;
+    uint64_t sink = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t it = 0; it < iterations; it++) {
+        const uint8_t* p = buffer.data();
+        for (size_t i = 0; i < nPackets; p += sizes[i++]) {
+            RTCPCompoundParser parser(p, sizes[i]);
+            RTCPPacketView packet;
+            while (parser.next(packet) == eRTCP_OK) {
+                if (packet.type() == eRTCP_SR) {
+                    RTCPSenderReportView sr(packet);
+                    for (unsigned n = 0; n < sr.count(); n++) {
+                        RTCPReportBlockView block = sr.report(n);
+                        sink += block.ssrc() + block.cumulative_lost() + block.jitter() + block.dlsr();
+                    }
+                    reports += sr.count();
+                }
+            }
+            bad += (parser.status() != eRTCP_END);
+        }
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "parser: " << nPackets * iterations << " compound packets, "
+              << reports << " report blocks in " << secs << " s ("
+              << reports / secs / 1e6 << " M blocks/s, "
+              << nPackets * iterations / secs / 1e6 << " M packets/s, "
+              << bad << " bad, " << (sink & 0xff) << ")" << std::endl;
+}
+
+/*
+ * Prints every report block of the synthetic compound packets with the
+ * given format into /dev/null through a single output buffer.
+ */
+void bench_printer(RTCPPrintFormat format, size_t nPackets, size_t iterations) {
+    std::vector<uint8_t> packet(512);
+    size_t size = build_compound(packet.data(), 4, 1);
+    FILE* null = fopen("/dev/null", "w");
+    if (!null) return;
+    size_t blocks = 0, bytes = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    {
+        RTCPOutputBuffer out(null, 256 * 1024);
+        RTCPStreamPrinter printer(out, format);
+        for (size_t i = 0; i < nPackets * iterations; i++) {
+            RTCPCompoundParser parser(packet.data(), size);
+            RTCPPacketView view;
+            while (parser.next(view) == eRTCP_OK) {
+                if (view.type() != eRTCP_SR) continue;
+                RTCPSenderReportView sr(view);
+                for (unsigned n = 0; n < sr.count(); n++) {
+                    printer.print(sr.report(n));
+                    blocks++;
+                }
             }
         }
-        ss << std::endl;
-        offset += sizeof(uint32_t) * 8;
-    } while ( ++line < sizeof(RTCPReceiverBlock) / sizeof(uint32_t) );
-    return ss.str();
+        bytes = out.written();
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    fclose(null);
+    std::cout << "printer format=" << format << ": " << blocks << " blocks in " << secs << " s ("
+              << blocks / secs / 1e6 << " M blocks/s, "
+              << bytes / secs / (1024 * 1024) << " MB/s)" << std::endl;
 }
 
 using namespace std;
@@ -123,5 +355,42 @@ int main(int argc, char** argv) {
 
     cout << print(test, true);
 
+    uint8_t packet[512];
+    size_t size = build_compound(packet, 2, 100);
+    RTCPCompoundParser parser(packet, size);
+    RTCPPacketView view;
+    while (parser.next(view) == eRTCP_OK) {
+        cout << "packet type=" << view.type() << " count=" << view.count()
+             << " size=" << view.size() << endl;
+        if (view.type() == eRTCP_SR) {
+            RTCPSenderReportView sr(view);
+            cout << print(sr.report(0).to_host(), true);
+            cout.flush();
+            RTCPOutputBuffer out(stdout);
+            RTCPStreamPrinter hex(out, eRTCP_PRINT_HEX), compact(out, eRTCP_PRINT_COMPACT),
+                              json(out, eRTCP_PRINT_JSON);
+            for (unsigned i = 0; i < sr.count(); i++) {
+                hex.print(sr.report(i));
+                compact.print(sr.report(i));
+                json.print(sr.report(i));
+            }
+        } else if (view.type() == eRTCP_SDES) {
+            RTCPSdesView(view).for_each_item([](uint32_t ssrc, const RTCPSdesItem& item) {
+                cout << "  ssrc=" << ssrc << " item=" << (int)item.type << " "
+                     << string(item.text, item.length) << endl;
+            });
+        } else if (view.type() == eRTCP_BYE) {
+            RTCPByeView bye(view);
+            cout << "  ssrc=" << bye.ssrc(0) << " reason=" << string(bye.reason(), bye.reason_size()) << endl;
+        }
+    }
+    cout << "parser status: " << parser.status() << endl;
+
+    bench_parser(1000, 2000);
+    bench_printer(eRTCP_PRINT_BINARY, 1000, 250);
+    bench_printer(eRTCP_PRINT_HEX, 1000, 250);
+    bench_printer(eRTCP_PRINT_COMPACT, 1000, 250);
+    bench_printer(eRTCP_PRINT_JSON, 1000, 250);
+
     return 0;
 }
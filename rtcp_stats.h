@@ -0,0 +1,268 @@
+#ifndef RTCP_STATS_H
+#define RTCP_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+#include "rtcp_packet.h"
+
+/*
+ * Batched RTCP receiver statistics (RFC 3550, 6.4).
+ *
+ * NTP timestamps are kept packed in one 64-bit integer: seconds in the high
+ * 32 bits and the binary fraction in the low 32 bits. LSR/DLSR and the
+ * arrival time are the middle 32 bits of that value (16.16 fixed point), so
+ * round-trip time is plain 32-bit modular arithmetic.
+ *
+ * Reports are collected into an RTCPReportBatch (one array per field) and
+ * RTCPStatsEngine::update() processes the whole batch: the per-report math
+ * runs as separate loops over the arrays with no branches or divisions, so
+ * the compiler can vectorize them, and only the final scatter into the
+ * per-SSRC state touches the streams one by one.
+ */
+
+typedef uint64_t ntp64_t;
+
+inline ntp64_t ntp_make(uint32_t secs, uint32_t frac) {
+    return ((ntp64_t)secs << 32) | frac;
+}
+
+/**
+ * @brief Middle 32 bits of the timestamp, the format of LSR and DLSR.
+ */
+inline uint32_t ntp_middle32(ntp64_t ts) {
+    return (uint32_t)(ts >> 16);
+}
+
+inline uint64_t ntp_to_us(ntp64_t ts) {
+    return (ts >> 32) * 1000000ULL + (((ts & 0xFFFFFFFFULL) * 1000000ULL) >> 32);
+}
+
+inline ntp64_t ntp_from_us(uint64_t us) {
+    return ntp_make((uint32_t)(us / 1000000), (uint32_t)(((us % 1000000) << 32) / 1000000));
+}
+
+/**
+ * @brief Converts a 16.16 fixed-point duration to microseconds.
+ */
+inline uint64_t ntp32_to_us(uint32_t v) {
+    return ((uint64_t)v * 15625) >> 10; // v * 1000000 / 65536
+}
+
+/**
+ * @brief Report blocks of one batch, one array per field.
+ */
+struct RTCPReportBatch {
+    std::vector<uint32_t> ssrc;
+    std::vector<uint8_t>  fractionLost;
+    std::vector<int32_t>  cumulativeLost;
+    std::vector<uint32_t> highestSeq;
+    std::vector<uint32_t> jitter;
+    std::vector<uint32_t> lsr;
+    std::vector<uint32_t> dlsr;
+    std::vector<uint32_t> arrival; // middle 32 bits of the arrival time
+
+    size_t size() const { return ssrc.size(); }
+
+    void clear() {
+        ssrc.clear(); fractionLost.clear(); cumulativeLost.clear(); highestSeq.clear();
+        jitter.clear(); lsr.clear(); dlsr.clear(); arrival.clear();
+    }
+
+    void reserve(size_t n) {
+        ssrc.reserve(n); fractionLost.reserve(n); cumulativeLost.reserve(n); highestSeq.reserve(n);
+        jitter.reserve(n); lsr.reserve(n); dlsr.reserve(n); arrival.reserve(n);
+    }
+
+    void push(const RTCPReportBlockView& block, ntp64_t arrivalTime) {
+        ssrc.push_back(block.ssrc());
+        fractionLost.push_back(block.fraction_lost());
+        cumulativeLost.push_back(block.cumulative_lost());
+        highestSeq.push_back(block.highest_seq());
+        jitter.push_back(block.jitter());
+        lsr.push_back(block.lsr());
+        dlsr.push_back(block.dlsr());
+        arrival.push_back(ntp_middle32(arrivalTime));
+    }
+};
+
+/**
+ * @brief Latest statistics of one stream.
+ */
+struct RTCPStreamStats {
+    uint32_t ssrc;
+    uint32_t rttUs;         // last round-trip time, UINT32_MAX if unknown
+    uint32_t minRttUs;      // lowest round-trip time seen, UINT32_MAX if unknown
+    uint32_t jitterUs;      // interarrival jitter
+    int32_t  cumulativeLost;
+    uint8_t  fractionLost;  // loss fraction reported for the last interval, 1/256 units
+    uint32_t highestSeq;
+    uint32_t intervalExpected; // packets expected between the last two reports
+    int32_t  intervalLost;     // packets lost between the last two reports
+    uint32_t reports;
+};
+
+class RTCPStatsEngine {
+public:
+    static const uint32_t NO_RTT = UINT32_MAX;
+    static const uint32_t DEFAULT_CLOCK_RATE = 90000;
+
+    RTCPStatsEngine() {}
+
+    size_t streams() const { return m_ssrc.size(); }
+
+    /**
+     * @brief Sets the RTP clock rate used to convert the jitter of a stream
+     * to microseconds. Streams use DEFAULT_CLOCK_RATE until it is set.
+     */
+    void set_clock_rate(uint32_t ssrc, uint32_t hz) {
+        if (hz == 0) return;
+        m_jitterScale[slot(ssrc)] = jitter_scale(hz);
+    }
+
+    /**
+     * @brief Updates the statistics with every report of the batch.
+     * Reports of the same stream are applied in batch order.
+     */
+    void update(const RTCPReportBatch& batch) {
+        const size_t n = batch.size();
+        m_slot.resize(n);
+        m_rtt.resize(n);
+        m_scale.resize(n);
+        m_jitter.resize(n);
+
+        // SSRC -> stream slot, the only hash lookups of the batch
+        uint32_t lastSsrc = 0, lastSlot = 0;
+        bool haveLast = false;
+        for (size_t i = 0; i < n; i++) {
+            if (!haveLast || batch.ssrc[i] != lastSsrc) {
+                lastSsrc = batch.ssrc[i];
+                lastSlot = slot(lastSsrc);
+                haveLast = true;
+            }
+            m_slot[i] = lastSlot;
+        }
+
+        // RTT = A - LSR - DLSR, valid when an SR was received (LSR != 0)
+        // and the result is not negative
+        const uint32_t* arrival = batch.arrival.data();
+        const uint32_t* lsr = batch.lsr.data();
+        const uint32_t* dlsr = batch.dlsr.data();
+        uint32_t* rtt = m_rtt.data();
+        for (size_t i = 0; i < n; i++) {
+            uint32_t d = arrival[i] - lsr[i] - dlsr[i];
+            uint32_t us = (uint32_t)ntp32_to_us(d & 0x7FFFFFFF);
+            bool valid = (lsr[i] != 0) & ((d >> 31) == 0);
+            rtt[i] = valid ? us : (uint32_t)NO_RTT;
+        }
+
+        // jitter: RTP timestamp units -> microseconds
+        const uint32_t* slots = m_slot.data();
+        const uint32_t* streamScale = m_jitterScale.data();
+        uint32_t* scale = m_scale.data();
+        for (size_t i = 0; i < n; i++) {
+            scale[i] = streamScale[slots[i]];
+        }
+        const uint32_t* jitter = batch.jitter.data();
+        uint32_t* jitterUs = m_jitter.data();
+        for (size_t i = 0; i < n; i++) {
+            jitterUs[i] = (uint32_t)(((uint64_t)jitter[i] * scale[i]) >> 16);
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            uint32_t s = slots[i];
+            if (m_reports[s]) {
+                m_intervalExpected[s] = batch.highestSeq[i] - m_highestSeq[s];
+                m_intervalLost[s] = batch.cumulativeLost[i] - m_cumulativeLost[s];
+            }
+            if (rtt[i] != NO_RTT) {
+                m_rttUs[s] = rtt[i];
+                if (rtt[i] < m_minRttUs[s]) m_minRttUs[s] = rtt[i];
+            }
+            m_jitterUs[s] = jitterUs[i];
+            m_cumulativeLost[s] = batch.cumulativeLost[i];
+            m_fractionLost[s] = batch.fractionLost[i];
+            m_highestSeq[s] = batch.highestSeq[i];
+            m_reports[s]++;
+        }
+    }
+
+    RTCPStreamStats stats(size_t slot) const {
+        RTCPStreamStats st;
+        st.ssrc             = m_ssrc[slot];
+        st.rttUs            = m_rttUs[slot];
+        st.minRttUs         = m_minRttUs[slot];
+        st.jitterUs         = m_jitterUs[slot];
+        st.cumulativeLost   = m_cumulativeLost[slot];
+        st.fractionLost     = m_fractionLost[slot];
+        st.highestSeq       = m_highestSeq[slot];
+        st.intervalExpected = m_intervalExpected[slot];
+        st.intervalLost     = m_intervalLost[slot];
+        st.reports          = m_reports[slot];
+        return st;
+    }
+
+    /**
+     * @brief Looks up a stream by SSRC.
+     *
+     * @return false if no report of the stream was seen
+     */
+    bool find(uint32_t ssrc, RTCPStreamStats& st) const {
+        std::unordered_map<uint32_t, uint32_t>::const_iterator it = m_index.find(ssrc);
+        if (it == m_index.end()) {
+            return false;
+        }
+        st = stats(it->second);
+        return true;
+    }
+
+private:
+    static uint32_t jitter_scale(uint32_t hz) {
+        uint64_t scale = (1000000ULL << 16) / hz;
+        return (scale > UINT32_MAX) ? UINT32_MAX : (uint32_t)scale;
+    }
+
+    uint32_t slot(uint32_t ssrc) {
+        std::pair<std::unordered_map<uint32_t, uint32_t>::iterator, bool> res =
+            m_index.insert(std::make_pair(ssrc, (uint32_t)m_ssrc.size()));
+        if (res.second) {
+            m_ssrc.push_back(ssrc);
+            m_jitterScale.push_back(jitter_scale(DEFAULT_CLOCK_RATE));
+            m_rttUs.push_back((uint32_t)NO_RTT);
+            m_minRttUs.push_back((uint32_t)NO_RTT);
+            m_jitterUs.push_back(0);
+            m_cumulativeLost.push_back(0);
+            m_fractionLost.push_back(0);
+            m_highestSeq.push_back(0);
+            m_intervalExpected.push_back(0);
+            m_intervalLost.push_back(0);
+            m_reports.push_back(0);
+        }
+        return res.first->second;
+    }
+
+    std::unordered_map<uint32_t, uint32_t> m_index;
+
+    // per-stream state, indexed by slot
+    std::vector<uint32_t> m_ssrc;
+    std::vector<uint32_t> m_jitterScale; // microseconds per RTP tick, 16.16
+    std::vector<uint32_t> m_rttUs;
+    std::vector<uint32_t> m_minRttUs;
+    std::vector<uint32_t> m_jitterUs;
+    std::vector<int32_t>  m_cumulativeLost;
+    std::vector<uint8_t>  m_fractionLost;
+    std::vector<uint32_t> m_highestSeq;
+    std::vector<uint32_t> m_intervalExpected;
+    std::vector<int32_t>  m_intervalLost;
+    std::vector<uint32_t> m_reports;
+
+    // per-batch scratch, reused between updates
+    std::vector<uint32_t> m_slot;
+    std::vector<uint32_t> m_rtt;
+    std::vector<uint32_t> m_scale;
+    std::vector<uint32_t> m_jitter;
+};
+
+#endif